@@ -5,22 +5,42 @@
  * This code includes:
  * - an assembly version for ARMv6-M (tested on cortex-M0+)
  *   using tables (8-bit chunks)
+ * - a portable C version using tables, for hosts without a
+ *   (fast) multiplier, with a configurable window size
  *
+ * The window size is set with TABLE_BITS (1, 2, 4, 8 or 16):
+ * the tables use 64/TABLE_BITS windows of 2^TABLE_BITS entries,
+ * i.e. 16 KiB for 8-bit windows and 2 KiB for 4-bit windows.
+ * The assembly version is used on ARM when TABLE_BITS is 8,
+ * unless TABLE_PORTABLE is defined.
+ *
+ * The tables are computed by MAC611_init for key 0 and for the first
+ * TABLE_CACHE rekeys, and are read-only afterwards: MAC611_tag can be
+ * called concurrently on a shared context. Tables for later keys are
+ * built in scratch space: the scratch table of the context for
+ * MAC611_tag (claimed by one call at a time, concurrent calls multiply
+ * without tables), or provided by the caller with MAC611_tag_scratch.
+ * Nothing of table size is put on the stack, and MAC611_tag never
+ * allocates.
  *
  * Notes:
- * - the code assumes a LITTLE ENDIAN core
+ * - the assembly code assumes a LITTLE ENDIAN core
  * - inline assembly uses the old syntax for ARMv6-M (for better GCC compatilibility)
  ************************************************************/
-char MUL_IMPLEM[] = "ARMv6-M assembly using tables";
-
-/*** Setup Macros ***/
-
-#define LAMBDA 1024 // Nb of blocks per key.
 
 #include "MAC611.h"
-#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define str(x) str_(x)
+#define str_(x) #x
+
+#if defined(__thumb__) && TABLE_BITS == 8 && !defined(TABLE_PORTABLE)
+#define TABLE_ASM
+char MUL_IMPLEM[] = "ARMv6-M assembly using tables";
+#else
+char MUL_IMPLEM[] = "Portable C using tables (" str(TABLE_BITS) "-bit windows)";
+#endif
 
 static inline uint64_t make64(uint32_t a, uint32_t b) {
   union { uint64_t u64; uint32_t u32[2]; } t;
@@ -35,6 +55,7 @@ static inline uint64_t make64(uint32_t a, uint32_t b) {
  */
 
 // Partial reduce to [0 .. 2^61+6]
+#ifdef TABLE_ASM
 static inline uint64_t reduce(uint64_t x) {
   uint32_t xl = x;
   uint32_t xh = x>>32;
@@ -51,6 +72,11 @@ static inline uint64_t reduce(uint64_t x) {
 
   return make64(xl, xh);
 }
+#else  // TABLE_ASM
+static inline uint64_t reduce(uint64_t x) {
+  return (x&MOD611) + (x>>61);
+}
+#endif // TABLE_ASM
 
 // Full reduce to [0 .. 2^61-2]
 static inline uint64_t REDUCE_FULL(uint64_t x) {
@@ -68,33 +94,38 @@ static inline uint64_t reduce_mini(uint64_t x) {
   return x;
 }
 
-static inline void init_table(const struct MAC611_context * ctx, int k) {
-  uint64_t tmp[2] = {0, k};
-  Noekeon_encrypt(ctx->noekeon_key, (uint8_t*)tmp, (uint8_t*)tmp);
-  uint64_t x = REDUCE_FULL(tmp[0]);
+// Hash key k (k-th Noekeon output)
+static uint64_t hash_key(const uint8_t noekeon_key[16], uint64_t k) {
+  uint8_t tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+  Noekeon_encrypt(noekeon_key, tmp, tmp);
+  return REDUCE_FULL(read64(tmp));
+}
+
+// Compute the tables of hash key k
+static void init_table(const uint8_t noekeon_key[16], uint64_t k, uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]) {
+  uint64_t x = hash_key(noekeon_key, k);
 
   // Table elements are just reduced to 0...2^61-1 (versus 0..2^61-2) for full reduce
-  for (int i=0; i<8; i++) {
-    ctx->mul_table[i][0] = 0;
+  for (int i=0; i<TABLE_WINDOWS; i++) {
+    mt[i][0] = 0;
     if (i == 0)
-      ctx->mul_table[i][1] = x;
+      mt[i][1] = x;
     else
-      ctx->mul_table[i][1] = reduce_mini(2*ctx->mul_table[i-1][128]);
+      mt[i][1] = reduce_mini(2*mt[i-1][TABLE_SIZE/2]);
 
-    for (int j=2; j<256; j++) {
-      ctx->mul_table[i][j] = reduce_mini(ctx->mul_table[i][j-1]+ctx->mul_table[i][1]);
+    for (int j=2; j<TABLE_SIZE; j++) {
+      mt[i][j] = reduce_mini(mt[i][j-1]+mt[i][1]);
     }
   }
 }
 
 
+#ifdef TABLE_ASM
 uint64_t mul611_mt(uint64_t x, const uint64_t mt[8][256]) {
   register uint32_t output0 = 0, output1 = 0;
 
   // Note: registers for ldm are harcoded, because
   // we cannot force GCC to have %[t0] < %[t1] (needed for ldm)
-#define str(x) str_(x)
-#define str_(x) #x
   // Add from tables
 #define STEP(i,dir,n)                                                   \
   "ls" str(dir) " r7, %[x], #" str(n) "\n\t"				\
@@ -124,109 +155,331 @@ uint64_t mul611_mt(uint64_t x, const uint64_t mt[8][256]) {
   return reduce(make64(output0, output1));
 }
 
-#if 0
-// Muliplication function for debug purpose
-uint64_t mul611(uint64_t x, uint64_t y) {
-  uint64_t (*mt)[256] = (uint64_t (*)[256])malloc(8*256*sizeof(uint64_t));
-  if (!mt) {
-    printf("Malloc failed (mul611)!\r\n");
-    exit(-1);
+#else  // TABLE_ASM
+
+/*
+ * Portable version: add one table entry per window of x.
+ * Entries are below 2^61, so at most 8 of them can be summed
+ * before a partial reduction (only needed for windows < 8 bits).
+ * Reduced sums are below 2^61+8: the accumulator takes 7 of them,
+ * and is reduced before the 8th (64 windows, 1-bit).
+ */
+static inline uint64_t mul611_mt(uint64_t x, const uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]) {
+  uint64_t acc = 0;
+
+  for (int g=0; g<TABLE_WINDOWS; g+=8) {
+    uint64_t s = 0;
+    for (int i=g; i<g+8 && i<TABLE_WINDOWS; i++)
+      s += mt[i][(x >> (i*TABLE_BITS)) & (TABLE_SIZE-1)];
+    if (TABLE_WINDOWS > 7*8 && g && g % (7*8) == 0)
+      acc = reduce(acc);
+    acc += TABLE_WINDOWS > 8? reduce(s): s;
   }
-  init_table(y, mt);
-  uint64_t z = mul611_mt(x, mt);
-  free(mt);
-  return z;
+
+  return reduce(acc);
+}
+
+#endif // TABLE_ASM
+
+// Not inlined in the callers: a call more than in MAC611_tag
+uint64_t MAC611_mul_table (uint64_t x, const uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]) {
+  return mul611_mt(x, mt);
+}
+
+void MAC611_build_table (const uint8_t noekeon_key[16], uint64_t k, uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]) {
+  init_table(noekeon_key, k, mt);
+}
+
+/*
+ * Multiplication without tables, for long messages when the scratch
+ * tables of the context are in use: 32x32-bit products, 2^64 = 8 and
+ * 2^61 = 1 (mod 2^61-1). x below 2^64, y below 2^61; the result is
+ * below 2^63.
+ */
+static uint64_t mul611_direct(uint64_t x, uint64_t y) {
+  x = REDUCE_FULL(x);
+  uint32_t xl = x, xh = x>>32, yl = y, yh = y>>32; // xh, yh < 2^29
+  uint64_t mid = (uint64_t)xh*yl + (uint64_t)xl*yh; // < 2^62
+  return reduce((uint64_t)xl*yl) + 8*((uint64_t)xh*yh)
+    + (mid>>29) + ((mid & ((1ULL<<29)-1)) << 32);
+}
+
+// Claim word of the scratch tables of a context (0: free)
+static inline uint32_t * scratch_claim (const struct MAC611_context * ctx) {
+  return (uint32_t *)((uint8_t *)ctx->scratch + MUL_TABLE_BYTES);
+}
+
+/*
+ * MAC611 initialization, using caller-provided memory for the tables.
+ * Computes the tables of key 0 and of the first TABLE_CACHE rekeys;
+ * they are never modified afterwards.
+ * mem must be 8-byte aligned (64-byte recommended) and hold at least
+ * MAC611_TABLES_BYTES; it must outlive the context.
+ * Returns 0, or -1 if mem is unsuitable.
+ */
+int MAC611_init_mem (struct MAC611_context * ctx, const uint8_t k[16], void * mem, size_t size) {
+  if (!mem || ((uintptr_t)mem & (sizeof(uint64_t)-1)) || size < MAC611_TABLES_BYTES)
+    return -1;
+
+  uint64_t (*mt)[TABLE_WINDOWS][TABLE_SIZE] = (uint64_t (*)[TABLE_WINDOWS][TABLE_SIZE])mem;
+  memcpy(ctx->noekeon_key, k, 16);
+  ctx->alloc = NULL;
+  // Compute first hash key, and cached rekeys
+  for (int i=0; i<=TABLE_CACHE; i++)
+    init_table(ctx->noekeon_key, i, mt[i]);
+  ctx->mul_table = (const uint64_t (*)[TABLE_WINDOWS][TABLE_SIZE])mt;
+  // Followed by the scratch tables and their claim word (free)
+  ctx->scratch = mt[TABLE_CACHE+1];
+  *scratch_claim(ctx) = 0;
+  return 0;
 }
-#endif
 
 /*
  * MAC611 initialization.
+ * Allocates the tables; they must be released with MAC611_free.
+ * Returns 0, or -1 if the allocation failed.
  */
-void MAC611_init (struct MAC611_context * ctx, const uint8_t k[16]) {
-  ((uint64_t*)ctx->noekeon_key)[0] = ((uint64_t*)k)[0];
-  ((uint64_t*)ctx->noekeon_key)[1] = ((uint64_t*)k)[1];
-  ctx->mul_table = (uint64_t (*)[256])malloc(8*256*sizeof(uint64_t));
-  if (!ctx->mul_table) {
-    printf("Malloc failed (MAC611_init)!\r\n");
-    exit(-1);
+int MAC611_init (struct MAC611_context * ctx, const uint8_t k[16]) {
+  void *mem = malloc(MAC611_TABLES_BYTES);
+  if (MAC611_init_mem(ctx, k, mem, MAC611_TABLES_BYTES)) {
+    free(mem);
+    return -1;
   }
-  // Compute first hash key
-  init_table(ctx, 0);
+  ctx->alloc = mem;
+  return 0;
 }
 
+/*
+ * Initialization of n contexts, with the tables laid out contiguously in
+ * a single slab of MAC611_BULK_BYTES(n) bytes provided by the caller.
+ * Each context starts on a MAC611_TABLES_ALIGN boundary of the slab,
+ * which should itself be aligned (ideally on a page boundary).
+ * Returns 0, or -1 if the slab is unsuitable.
+ */
+int MAC611_init_bulk (struct MAC611_context * ctx, const uint8_t (*k)[16], size_t n, void * slab, size_t size) {
+  if (!slab || ((uintptr_t)slab & (MAC611_TABLES_ALIGN-1)) || size/MAC611_TABLES_STRIDE < n)
+    return -1;
+
+  for (size_t i=0; i<n; i++)
+    MAC611_init_mem(&ctx[i], k[i], (uint8_t*)slab + i*MAC611_TABLES_STRIDE, MAC611_TABLES_STRIDE);
+  return 0;
+}
 
 /*
- * MAC611 tag evaluation
+ * Release a context.
+ * Frees the tables allocated by MAC611_init (caller-provided memory is
+ * left to the caller). The context must be initialized again before use.
+ */
+void MAC611_free (struct MAC611_context * ctx) {
+  free(ctx->alloc);
+  ctx->alloc = NULL;
+  ctx->mul_table = NULL;
+  ctx->scratch = NULL;
+}
+
+
+// Tables for key index k: from the context if cached, otherwise built in scratch
+static inline const uint64_t (*get_table(const struct MAC611_context * ctx, uint64_t k,
+					  uint64_t scratch[TABLE_WINDOWS][TABLE_SIZE]))[TABLE_SIZE] {
+  if (k <= TABLE_CACHE)
+    return ctx->mul_table[k];
+  init_table(ctx->noekeon_key, k, scratch);
+  return (const uint64_t (*)[TABLE_SIZE]) scratch;
+}
+
+
+// Finalization: Encrypt H||N
+static void tag_final (const struct MAC611_context * ctx, uint64_t state, const uint8_t nonce[8], uint8_t tag[8]) {
+  state = REDUCE_FULL(state) + (1ULL<<63);
+  uint8_t S[16] = { write64(state) };
+  memcpy(S+8, nonce, 8);
+  Noekeon_encrypt(ctx->noekeon_key, S, S);
+
+  memcpy(tag, S, 8);
+}
+
+/*
+ * MAC611 tag evaluation, with caller-provided scratch space
  * The context should be initialized using MAC611_init.
  * len is the message length in bytes
+ * scratch is only used for keys that are not cached in the context,
+ * i.e. for messages of more than 7*LAMBDA*(TABLE_CACHE+1)-6 bytes;
+ * it must not be shared between concurrent calls.
  *
  * NOTE: !!! ARMv6-M does not allow unaligned reads !!!
  */
 
-void MAC611_tag (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+void MAC611_tag_scratch (const struct MAC611_context * ctx, uint64_t scratch[TABLE_WINDOWS][TABLE_SIZE],
+			 const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
   /*** Universal hash ***/
   uint64_t state = 0;
-  int new_tables = 0;
+  const uint64_t (*mt)[TABLE_SIZE] = get_table(ctx, 0, scratch);
   
   int cnt = LAMBDA;
-  int k = 0;
+  uint64_t k = 0;
+  size_t n = len/7;
 
+#ifdef TABLE_ASM
   /*** Unroll to optimize unaligned reads ***/
-  size_t n = len/7;
   const uint32_t * p = (uint32_t*)M;
   while ((uint8_t*)p <= M+len-7) {
     uint64_t t = make64(p[0], p[1]&0x00ffffff);
     state += t;
-    state = mul611_mt(state, ctx->mul_table);
+    state = mul611_mt(state, mt);
     if ((uint8_t*)p+7 > M+len-7)
       break;
     t = make64((p[1]>>24)|(p[2]<<8), ((p[2]>>24)|(p[3]<<8))&0x00ffffff);
     state += t;
-    state = mul611_mt(state, ctx->mul_table);
+    state = mul611_mt(state, mt);
     if ((uint8_t*)p+14 > M+len-7)
       break;
     t = make64((p[3]>>16)|(p[4]<<16), ((p[4]>>16)|(p[5]<<16))&0x00ffffff);
     state += t;
-    state = mul611_mt(state, ctx->mul_table);
+    state = mul611_mt(state, mt);
     if ((uint8_t*)p+21 > M+len-7)
       break;
     t = make64((p[5]>>8)|(p[6]<<24), p[6]>>8);
     state += t;
-    state = mul611_mt(state, ctx->mul_table);
+    state = mul611_mt(state, mt);
     p += 7;
 
     cnt -= 4;
     if (cnt == 0) {
-      // Overwrite table in-place
-      init_table(ctx, ++k);
+      mt = get_table(ctx, ++k, scratch);
       cnt = LAMBDA;
-      new_tables = 1;
     }
   }
+#else  // TABLE_ASM
+  /*** Full blocks ***/
+  for (size_t i=0; i<n; i++) {
+    state += read56(M+7*i);
+    state = mul611_mt(state, mt);
+
+    if (--cnt == 0) {
+      mt = get_table(ctx, ++k, scratch);
+      cnt = LAMBDA;
+    }
+  }
+#endif // TABLE_ASM
 
   /*** Partial last block ***/
   if (len%7) {
     // Read bytes
-    union { uint64_t u64; uint8_t u8[8]; } t;
-    t.u64 = 0;
-    for (int i=0; i<len%7; i++) {
-      t.u8[i] = M[7*n+i];
-    }
-    state += t.u64;
-    state = mul611_mt(state, ctx->mul_table);
+    uint64_t t = 0;
+    for (size_t i=0; i<len%7; i++)
+      t |= (uint64_t)M[7*n+i] << (8*i);
+    state += t;
+    state = mul611_mt(state, mt);
+
+    // The partial block also counts towards the key lifetime
+    if ((n+1)%LAMBDA == 0)
+      mt = get_table(ctx, ++k, scratch);
   }  
 
   // Length padding
   state += len;
-  state = mul611_mt(state, ctx->mul_table);
+  state = mul611_mt(state, mt);
 
-  /*** Finalization: Encrypt H||N ***/
-  state = REDUCE_FULL(state) + (1ULL<<63);
-  uint64_t S[2] = { state, *(uint64_t*)nonce };
-  Noekeon_encrypt(ctx->noekeon_key, (uint8_t*)S, (uint8_t*)S);
+  tag_final(ctx, state, nonce, tag);
+}
+
+/*
+ * Long messages without the scratch tables of the context: same hash
+ * with mul611_direct, the keys being computed as for the tables
+ */
+static void tag_direct (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+  uint64_t state = 0;
+  uint64_t key = hash_key(ctx->noekeon_key, 0);
+  uint64_t k = 0;
+  size_t n = len/7;
+
+  for (size_t i=0; i<=n; i++) {
+    if (i == n && len%7 == 0)
+      break;
+    uint64_t t = 0;
+    if (i < n)
+      t = read56(M+7*i);
+    else
+      for (size_t j=0; j<len%7; j++)
+	t |= (uint64_t)M[7*n+j] << (8*j);
+    state += t;
+    state = mul611_direct(state, key);
+
+    // Rekey (the partial block also counts towards the key lifetime)
+    if ((i+1)%LAMBDA == 0)
+      key = hash_key(ctx->noekeon_key, ++k);
+  }
+
+  // Length padding
+  state += len;
+  state = mul611_direct(state, key);
 
-  ((uint64_t*)tag)[0] = S[0];
-  // Restore initial table if needed
-  if (new_tables)
-    init_table(ctx, 0);
+  tag_final(ctx, state, nonce, tag);
+}
+
+/*
+ * Long messages: the scratch tables of the context if no other call
+ * holds them, otherwise (or for contexts without scratch tables)
+ * tag_direct; nothing is allocated. The claim is an atomic exchange,
+ * or on ARMv6-M (no exclusive accesses) a test and store with
+ * interrupts masked, so that a thread and an interrupt handler
+ * cannot both take it. On other targets without lock-free atomics,
+ * the scratch tables of the context are never shared: use
+ * MAC611_tag_scratch for speed.
+ */
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && __GCC_ATOMIC_INT_LOCK_FREE == 2
+#define CLAIM(p)   __atomic_exchange_n((p), 1, __ATOMIC_ACQUIRE)
+#define RELEASE(p) __atomic_store_n((p), 0, __ATOMIC_RELEASE)
+#elif defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_8M_BASE__)
+static inline uint32_t claim_primask (uint32_t * p) {
+  uint32_t primask;
+  asm volatile ("mrs %0, primask\n\t"
+		"cpsid i" : "=r" (primask) :: "memory");
+  uint32_t held = *p;
+  *p = 1;
+  // Restored rather than cpsie: the caller may run with interrupts masked
+  asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+  return held;
+}
+#define CLAIM(p)   claim_primask(p)
+#define RELEASE(p) do { asm volatile ("" ::: "memory"); *(p) = 0; } while (0)
+#else
+#define CLAIM(p)   1
+#define RELEASE(p) ((void)(p))
+#endif
+
+static __attribute__((noinline))
+void tag_long (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+  if (ctx->scratch && !CLAIM(scratch_claim(ctx))) {
+    MAC611_tag_scratch(ctx, (uint64_t (*)[TABLE_SIZE])ctx->scratch, M, len, nonce, tag);
+    RELEASE(scratch_claim(ctx));
+    return;
+  }
+  tag_direct(ctx, M, len, nonce, tag);
+}
+
+/*
+ * MAC611 tag evaluation
+ * The context should be initialized using MAC611_init.
+ * len is the message length in bytes
+ * Concurrent calls can share the context (only the claim of its
+ * scratch tables changes, for messages using keys above TABLE_CACHE);
+ * calls that do not get the scratch tables are slower, not blocked.
+ */
+void MAC611_tag (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+  // Number of blocks (including the partial one) / LAMBDA is the last key index
+  if ((len+6)/7/LAMBDA <= TABLE_CACHE)
+    MAC611_tag_scratch(ctx, NULL, M, len, nonce, tag);
+  else
+    tag_long(ctx, M, len, nonce, tag);
+}
+
+
+/*
+ * Tag verification: the tags are compared in constant time
+ */
+int MAC611_verify (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], const uint8_t tag[8]) {
+  uint8_t t[8];
+  MAC611_tag(ctx, M, len, nonce, t);
+  return MAC611_tag_equal(t, tag);
 }
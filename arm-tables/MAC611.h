@@ -25,11 +25,40 @@ void Noekeon_decrypt(const unsigned char * const key,
 /*** MAC611 interface ***/
 
 #define MOD611 ((1ULL<<61)-1)
+#define LAMBDA 1024 // Nb of blocks per key.
+
+/*** Multiplication tables: 64/TABLE_BITS windows of 2^TABLE_BITS entries ***/
+#ifndef TABLE_BITS
+#define TABLE_BITS 8
+#endif
+#define TABLE_WINDOWS (64/TABLE_BITS)
+#define TABLE_SIZE    (1<<TABLE_BITS)
+#define MUL_TABLE_BYTES (TABLE_WINDOWS*TABLE_SIZE*sizeof(uint64_t))
+
+/*** Nb of rekey tables (keys 1..TABLE_CACHE) precomputed in the context ***/
+#ifndef TABLE_CACHE
+#if defined(__thumb__)
+#define TABLE_CACHE 0
+#else
+#define TABLE_CACHE 3
+#endif
+#endif
+
+/*** Memory for the tables of one context (keys 0..TABLE_CACHE), the
+     scratch tables of later keys and their claim word ***/
+#define MAC611_TABLES_BYTES ((TABLE_CACHE+2)*MUL_TABLE_BYTES+sizeof(uint64_t))
+// Tables of several contexts in one slab start on cache line boundaries
+#define MAC611_TABLES_ALIGN 64
+#define MAC611_TABLES_STRIDE \
+  ((MAC611_TABLES_BYTES+MAC611_TABLES_ALIGN-1)/MAC611_TABLES_ALIGN*MAC611_TABLES_ALIGN)
+#define MAC611_BULK_BYTES(n) ((n)*MAC611_TABLES_STRIDE)
 
 struct MAC611_context {
   uint64_t hash_key;
   uint8_t noekeon_key[16];
-  uint64_t (*mul_table)[256];
+  const uint64_t (*mul_table)[TABLE_WINDOWS][TABLE_SIZE]; // Tables for keys 0..TABLE_CACHE, read-only after init
+  void *scratch; // Scratch tables of MAC611_tag for keys above TABLE_CACHE (NULL: none)
+  void *alloc; // Memory allocated by MAC611_init (NULL for caller-provided memory)
 };
 
 #ifdef __cplusplus
@@ -37,8 +66,26 @@ extern "C" {
 #endif
 extern char MUL_IMPLEM[];
 
-void MAC611_init (struct MAC611_context * context, const uint8_t k[16]);
+int  MAC611_init (struct MAC611_context * context, const uint8_t k[16]);
+int  MAC611_init_mem (struct MAC611_context * context, const uint8_t k[16], void * mem, size_t size);
+int  MAC611_init_bulk (struct MAC611_context * contexts, const uint8_t (*k)[16], size_t n, void * slab, size_t size);
+void MAC611_free (struct MAC611_context * context);
 void MAC611_tag (const struct MAC611_context * context, const uint8_t * m, size_t len, const uint8_t nonce[8], uint8_t tag[8]);
+void MAC611_tag_scratch (const struct MAC611_context * context, uint64_t scratch[TABLE_WINDOWS][TABLE_SIZE],
+			 const uint8_t * m, size_t len, const uint8_t nonce[8], uint8_t tag[8]);
+// 1 if tag is the tag of m, 0 otherwise (constant-time comparison)
+int  MAC611_verify (const struct MAC611_context * context, const uint8_t * m, size_t len, const uint8_t nonce[8], const uint8_t tag[8]);
+// 1 if the tags a and b are equal, in constant time
+static inline int MAC611_tag_equal (const uint8_t a[8], const uint8_t b[8]) {
+  uint8_t d = 0;
+  for (int i=0; i<8; i++)
+    d |= a[i] ^ b[i];
+  return d == 0;
+}
+// Building blocks, for the kernels mode of the benchmark harness:
+// x times the key of the tables mt, and the tables of key index k
+uint64_t MAC611_mul_table (uint64_t x, const uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]);
+void MAC611_build_table (const uint8_t noekeon_key[16], uint64_t k, uint64_t mt[TABLE_WINDOWS][TABLE_SIZE]);
 /* uint64_t mul611(uint64_t x, uint64_t y); */
 /* uint64_t REDUCE_611(uint64_t x); */
 #ifdef __cplusplus
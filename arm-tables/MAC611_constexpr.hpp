@@ -0,0 +1 @@
+../ref/MAC611_constexpr.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../ref/bench.cpp
\ No newline at end of file
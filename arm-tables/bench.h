@@ -0,0 +1 @@
+../ref/bench.h
\ No newline at end of file
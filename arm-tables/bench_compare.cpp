@@ -0,0 +1 @@
+../ref/bench_compare.cpp
\ No newline at end of file
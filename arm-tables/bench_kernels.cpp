@@ -0,0 +1 @@
+../ref/bench_kernels.cpp
\ No newline at end of file
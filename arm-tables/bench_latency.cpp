@@ -0,0 +1 @@
+../ref/bench_latency.cpp
\ No newline at end of file
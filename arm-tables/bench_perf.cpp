@@ -0,0 +1 @@
+../ref/bench_perf.cpp
\ No newline at end of file
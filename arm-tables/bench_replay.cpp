@@ -0,0 +1 @@
+../ref/bench_replay.cpp
\ No newline at end of file
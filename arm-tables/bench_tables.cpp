@@ -0,0 +1,74 @@
+/************************************************************
+ * MAC611 table-based implementation: window size benchmark
+ * (c) 2018-2019 XXXX
+ *
+ * Build one binary per window size (see Makefile), e.g.
+ *   make bench-tables
+ * Output is CSV, one line per message length:
+ *   bits,table_bytes,len,tag,min,median,unit
+ * min/median are per byte (per call for empty messages), timed
+ * with bench_start/bench_stop less the timer overhead (bench.h).
+ * The tag column must agree across window sizes.
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "bench.h" // Also MAC611.h
+
+static const size_t LENGTHS[] = { 0, 8, 16, 64, 256, 1024, 4096, 7168, 16384, 65536, 1<<20 };
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "-H") == 0)
+    printf ("bits,table_bytes,len,tag,min,median,unit\n");
+
+  uint8_t k[16] = {  0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+  		     0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 };
+  uint8_t N[8] = {0};
+  struct MAC611_context ctx;
+  if (MAC611_init(&ctx, k)) {
+    printf("Malloc failed (MAC611_init)!\n");
+    exit(-1);
+  }
+
+  size_t maxlen = LENGTHS[sizeof(LENGTHS)/sizeof(LENGTHS[0])-1];
+  uint8_t *M = (uint8_t*)malloc(maxlen);
+  if (!M) {
+    printf("Malloc failed (M)!\n");
+    exit(-1);
+  }
+  for (size_t i=0; i<maxlen; i++)
+    M[i] = i;
+
+  uint64_t overhead = bench_overhead();
+  for (size_t len : LENGTHS) {
+    // Aim for ~4 MB of input per length, with at least 15 runs
+    size_t reps = std::max<size_t>(15, (4u<<20)/(len+1));
+    std::vector<uint64_t> t(reps);
+    uint8_t tag[8];
+
+    MAC611_tag(&ctx, M, len, N, tag); // Warm up tables and caches
+    for (size_t r=0; r<reps; r++) {
+      uint64_t start = bench_start();
+      MAC611_tag(&ctx, M, len, N, tag);
+      uint64_t stop = bench_stop();
+      t[r] = stop-start > overhead? stop-start-overhead: 0;
+    }
+    std::sort(t.begin(), t.end());
+
+    double scale = len? (double)len: 1.0;
+    printf ("%d,%zu,%zu,", TABLE_BITS, sizeof(uint64_t)*TABLE_WINDOWS*TABLE_SIZE, len);
+    for (int i=0; i<8; i++)
+      printf ("%02x", tag[i]);
+    printf (",%.2f,%.2f,%s\n", t[0]/scale, t[reps/2]/scale, TICK_UNIT);
+  }
+
+  MAC611_free(&ctx);
+  free(M);
+  return 0;
+}
@@ -0,0 +1 @@
+../ref/bench_threads.cpp
\ No newline at end of file
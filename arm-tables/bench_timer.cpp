@@ -0,0 +1 @@
+../ref/bench_timer.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../ref/constexpr_check.cpp
\ No newline at end of file
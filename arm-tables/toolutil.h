@@ -0,0 +1 @@
+../ref/toolutil.h
\ No newline at end of file
@@ -332,3 +332,13 @@ void MAC611_tag (const struct MAC611_context * context, const uint8_t * M, size_
 
   ((uint64_t*)tag)[0] = S[0];
 }
+
+
+/*
+ * Tag verification: the tags are compared in constant time
+ */
+int MAC611_verify (const struct MAC611_context * context, const uint8_t * M, size_t len, const uint8_t nonce[8], const uint8_t tag[8]) {
+  uint8_t t[8];
+  MAC611_tag(context, M, len, nonce, t);
+  return MAC611_tag_equal(t, tag);
+}
@@ -6,100 +6,164 @@
  * - a generic C version (using 32+32->64 multiplier)
  * - a GNU C version (using 64+64->128 multiplier and 128-bit integers)
  *
- * The correct version is auto-detected with compiler macros
+ * The correct version is auto-detected with compiler macros (mul611.h)
+ *
+ * With REKEY_PIPELINE, the Noekeon rounds computing the next hash key
+ * are interleaved with the multiplications of the current chunk of
+ * LAMBDA blocks, instead of stalling the hash chain at each rekey.
+ *
+ * MAC611_start/MAC611_update/MAC611_finish compute the same tag as
+ * MAC611_tag incrementally (the partial block and the key lifetime
+ * are carried over between updates).
+ *
+ * MAC611_tag_x4 hashes four messages in lockstep (for batches of
+ * short messages), MAC611_verify compares tags in constant time.
+ *
+ * USDT probes (MAC611_probes.h, provider mac611):
+ * tag_entry(len), rekey(key index), final(len), tag_exit(len)
+ * around each tag; for the incremental interface tag_entry(0) in
+ * MAC611_start (the length is not known yet), update(len) per
+ * MAC611_update and tag_exit(total length) in MAC611_finish.
  ************************************************************/
 
-/*** Setup Macros ***/
-
-#define LAMBDA 1024 // Nb of blocks per key.
-
+#ifndef MAC611_REF
+#define MAC611_REF // Declares the interface of this implementation only
+#endif
 #include "MAC611.h"
+#include "mul611.h"
+#include "MAC611_probes.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+char MUL_IMPLEM[] = MUL611_IMPLEM;
+
+#ifdef MAC611_STATS
 /*
- * Multiplication mod 2^61-1
+ * Instrumentation counters (compiled with MAC611_STATS only)
+ * Each thread counts in its own slot, on its own cache lines, with
+ * plain loads and stores (relaxed atomic stores: no locked instruction).
+ * Slots are linked in a list the first time a thread uses the library,
+ * and never freed, so that the counts of exited threads are kept.
  */
+struct stats_slot {
+  struct MAC611_stats s;
+  struct stats_slot * next;
+} __attribute__((aligned(64)));
 
+static struct stats_slot * stats_list = NULL;
+static __thread struct stats_slot * stats_self = NULL;
 
-uint64_t REDUCE_611(uint64_t x) {
-  return x%(0x1fffffffffffffffULL);
+static struct stats_slot * stats_slot (void) {
+  struct stats_slot * p = stats_self;
+  if (__builtin_expect(p == NULL, 0)) {
+    p = aligned_alloc(64, sizeof(*p));
+    if (!p)
+      return NULL; // Not counted
+    memset(p, 0, sizeof(*p));
+    p->next = __atomic_load_n(&stats_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&stats_list, &p->next, p, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    stats_self = p;
+  }
+  return p;
 }
 
-#ifdef __SIZEOF_INT128__
+#define STAT_ADD(p, field, v) __atomic_store_n(&(p)->s.field, (p)->s.field + (v), __ATOMIC_RELAXED)
 
-/*** GCC version with 128-bit integer ***/
-char MUL_IMPLEM[] = "GCC int128";
-uint64_t mul611(uint64_t x, uint64_t y) {
-  unsigned __int128 z = (unsigned __int128) x*y;
-  return z%MOD611;
+static inline void stats_init (void) {
+  struct stats_slot * p = stats_slot();
+  if (p) {
+    STAT_ADD(p, inits, 1);
+    STAT_ADD(p, noekeon, 1);
+  }
 }
 
-#else  //__SIZEOF_INT128__
-
-/*** Generic C version ***/
-#define MUL32(a,b) ((uint64_t)(a)*(b))
-
-char MUL_IMPLEM[] = "Generic C";
-uint64_t mul611(uint64_t x, uint64_t y) {
-  // Split input
-  uint32_t xl = x;
-  uint32_t xh = x>>32;
-  uint32_t yl = y;
-  uint32_t yh = y>>32;
-
-  // 128-bit intermediate value
-  uint32_t m0 = 0;
-  uint32_t m1 = 0;
-  uint32_t m2 = 0;
-  uint32_t m3 = 0;
+static inline void stats_tag (size_t len, uint64_t rekeys) {
+  struct stats_slot * p = stats_slot();
+  if (p) {
+    int bits = len? 64-__builtin_clzll(len): 0;
+    STAT_ADD(p, finals, 1);
+    STAT_ADD(p, bytes, len);
+    STAT_ADD(p, blocks, (len+6)/7);
+    STAT_ADD(p, rekeys, rekeys);
+    STAT_ADD(p, noekeon, rekeys+1);
+    STAT_ADD(p, sizes[bits], 1);
+  }
+}
 
-  uint64_t t;
-  uint32_t th, tl;
+// Rekeys shared by several tags (MAC611_tag_x4), counted once
+static inline void stats_rekeys (uint64_t rekeys) {
+  struct stats_slot * p = stats_slot();
+  if (p && rekeys) {
+    STAT_ADD(p, rekeys, rekeys);
+    STAT_ADD(p, noekeon, rekeys);
+  }
+}
 
-  t = MUL32(xl, yl);
-  tl = t;
-  th = t>>32;
-  m0 = tl;
-  m1 = th;
+void MAC611_get_stats (struct MAC611_stats * stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (struct stats_slot * p = __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE); p; p = p->next) {
+    const uint64_t * src = (const uint64_t *)&p->s;
+    uint64_t * dst = (uint64_t *)stats;
+    for (size_t i=0; i<sizeof(*stats)/sizeof(uint64_t); i++)
+      dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+  }
+}
 
-  t = MUL32(xh, yh);
-  tl = t;
-  th = t>>32;
-  m2 = tl;
-  m3 = th;
+#define STATS_INIT()          stats_init()
+#define STATS_TAG(len, k)     stats_tag(len, k)
+#define STATS_REKEYS(k)       stats_rekeys(k)
+#else
+#define STATS_INIT()
+#define STATS_TAG(len, k)
+#define STATS_REKEYS(k)
+#endif // MAC611_STATS
 
-  t  = MUL32(xh, yl);
-  t += MUL32(xl, yh);
-  
-  tl = t;
-  th = t>>32;
-  m1 += tl;
-  th += (m1 < tl);
-  m2 += th;
-  m3 += (m2 < th);
-  
+#ifdef MAC611_PROFILE
+/*
+ * Per-stage profile (compiled with MAC611_PROFILE only)
+ * Blocks up to the next rekey are loaded into a buffer, then
+ * multiplied, so that each stage is between two fenced timestamps.
+ * Accumulated per thread over all calls.
+ */
+#ifdef REKEY_PIPELINE
+#error "MAC611_PROFILE times the stages of the non-pipelined code"
+#endif
 
-  // Reduce mod 2^61-1
-  uint32_t r0;
-  uint32_t r1;
-  uint32_t rr;
-  
-  r1  = m1&(0xffffffff>>3);
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t profile_ticks (void) {
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+}
+#else
+#include <time.h>
+static inline uint64_t profile_ticks (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#endif
 
-  r0 = m0;
-  rr = r0 + (m1>>29);
-  r1 += (rr < r0); // Carry!
-  r0  = rr + (m2<<3);
-  r1 += (r0 < rr); // Carry!
+static __thread struct MAC611_profile profile;
 
-  r1 += m2>>29;
-  r1 += m3<<3;
+#define PROFILE_STAGE(stage, t0, t1)		\
+  do {						\
+    profile.ticks[stage] += (t1)-(t0);		\
+    profile.intervals[stage]++;			\
+  } while (0)
 
-  return ((uint64_t)r1<<32) + r0;
+void MAC611_get_profile (struct MAC611_profile * p) {
+  *p = profile;
 }
 
-#endif //__SIZEOF_INT128__
+void MAC611_reset_profile (void) {
+  memset(&profile, 0, sizeof(profile));
+}
+#endif // MAC611_PROFILE
 
 /*
  * MAC611 initialization.
@@ -111,6 +175,7 @@ void MAC611_init (struct MAC611_context * ctx, const uint8_t k[16]) {
   unsigned char tmp[16] = {0};
   Noekeon_encrypt(ctx->noekeon_key, tmp, tmp);
   ctx->hash_key = REDUCE_611(read64(tmp));
+  STATS_INIT();
 }
 
 
@@ -126,9 +191,71 @@ void MAC611_tag (const struct MAC611_context * context, const uint8_t * M, size_
   
   int cnt = LAMBDA; // Key lifetime
   uint64_t k = 0;   // Key index
+  size_t l = 0;
 
+  MAC611_PROBE1(tag_entry, len);
+
+#ifdef REKEY_PIPELINE
+  // Full chunks of LAMBDA blocks: the next key only depends on k,
+  // one Noekeon round is computed every LAMBDA/NOEKEON_NROUND blocks
+  for (; len-l >= 7*LAMBDA; ) {
+    struct Noekeon_state next;
+    unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k+1) };
+    Noekeon_encrypt_start(&next, context->noekeon_key, tmp);
+
+    for (int r=0; r<NOEKEON_NROUND; r++) {
+      for (int i=0; i<LAMBDA/NOEKEON_NROUND; i++, l+=7) {
+	state += read56(M+l);
+	state = mul611(state, hash_key);
+      }
+      Noekeon_encrypt_round(&next);
+    }
+
+    Noekeon_encrypt_finish(&next, tmp);
+    hash_key = REDUCE_611(read64(tmp));
+    k++;
+    MAC611_PROBE1(rekey, k);
+  }
+#endif // REKEY_PIPELINE
+
+#ifdef MAC611_PROFILE
+  profile.calls++;
+  uint64_t t0 = profile_ticks(), t1, t2;
+  while (l < len) {
+    // Load blocks until the next rekey
+    uint64_t blk[LAMBDA];
+    int n = 0;
+    for (; l<len && n<cnt; l+=7, n++) {
+      uint64_t t = 0;
+      for (int i=0; i<7 && l+i<len; i++)
+	t |= (uint64_t)M[l+i] << (8*i);
+      blk[n] = t;
+    }
+    t1 = profile_ticks();
+    PROFILE_STAGE(MAC611_STAGE_LOAD, t0, t1);
+
+    for (int i=0; i<n; i++) {
+      state += blk[i];
+      state = mul611(state, hash_key);
+    }
+    t0 = profile_ticks();
+    PROFILE_STAGE(MAC611_STAGE_MUL, t1, t0);
+
+    if ((cnt -= n) == 0) {
+      k++;
+      unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+      Noekeon_encrypt(context->noekeon_key, tmp, tmp);
+      hash_key = REDUCE_611(read64(tmp));
+      cnt = LAMBDA;
+      MAC611_PROBE1(rekey, k);
+      t1 = profile_ticks();
+      PROFILE_STAGE(MAC611_STAGE_REKEY, t0, t1);
+      t0 = t1;
+    }
+  }
+#else
   // Read blocks of 7 bytes (56 bits), (last block can be partial)
-  for (size_t l=0; l<len; l+=7) {
+  for (; l<len; l+=7) {
     uint64_t t = 0;
     // Read bytes
     for (int i=0; i<7 && l+i<len; i++)
@@ -143,8 +270,10 @@ void MAC611_tag (const struct MAC611_context * context, const uint8_t * M, size_
       Noekeon_encrypt(context->noekeon_key, tmp, tmp);
       hash_key = REDUCE_611(read64(tmp));
       cnt = LAMBDA;
+      MAC611_PROBE1(rekey, k);
     }
   }
+#endif // MAC611_PROFILE
 
   // Length padding
   uint64_t t = len;
@@ -152,10 +281,187 @@ void MAC611_tag (const struct MAC611_context * context, const uint8_t * M, size_
   state = mul611(state, hash_key);
 
   // Finalization: Encrypt H||N
+  MAC611_PROBE1(final, len);
+#ifdef MAC611_PROFILE
+  t1 = profile_ticks();
+  PROFILE_STAGE(MAC611_STAGE_MUL, t0, t1);
+#endif
   state = REDUCE_611(state) + (1ULL<<63);
   uint8_t S[16] = { write64(state) };
   memcpy(S+8, nonce, 8);
   Noekeon_encrypt(context->noekeon_key, S, S);
 
   memcpy(tag, S, 8);
+#ifdef MAC611_PROFILE
+  t2 = profile_ticks();
+  PROFILE_STAGE(MAC611_STAGE_FINAL, t1, t2);
+#endif
+  STATS_TAG(len, k); // k rekeys
+  MAC611_PROBE1(tag_exit, len);
+}
+
+
+/*
+ * Incremental interface
+ */
+void MAC611_start (struct MAC611_stream * s, const struct MAC611_context * context) {
+  s->context = context;
+  s->state = 0;
+  s->hash_key = context->hash_key;
+  s->k = 0;
+  s->len = 0;
+  s->cnt = LAMBDA;
+  s->nbuf = 0;
+  MAC611_PROBE1(tag_entry, 0);
+}
+
+static inline void stream_block (struct MAC611_stream * s, uint64_t t) {
+  s->state += t;
+  s->state = mul611(s->state, s->hash_key);
+
+  if (--s->cnt == 0) {
+    s->k++;
+    unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(s->k) };
+    Noekeon_encrypt(s->context->noekeon_key, tmp, tmp);
+    s->hash_key = REDUCE_611(read64(tmp));
+    s->cnt = LAMBDA;
+    MAC611_PROBE1(rekey, s->k);
+  }
+}
+
+void MAC611_update (struct MAC611_stream * s, const uint8_t * m, size_t len) {
+  size_t l = 0;
+  s->len += len;
+  MAC611_PROBE1(update, len);
+
+  // Complete the pending block
+  if (s->nbuf) {
+    for (; l<len && s->nbuf<7; l++)
+      s->buf[s->nbuf++] = m[l];
+    if (s->nbuf < 7)
+      return;
+    stream_block(s, read56(s->buf));
+    s->nbuf = 0;
+  }
+
+  // Full blocks
+  for (; len-l >= 7; l+=7)
+    stream_block(s, read56(m+l));
+
+  // Keep the tail: it is only the last block if no more data follows
+  for (; l<len; l++)
+    s->buf[s->nbuf++] = m[l];
+}
+
+void MAC611_finish (struct MAC611_stream * s, const uint8_t nonce[8], uint8_t tag[8]) {
+  // Last block (partial)
+  if (s->nbuf) {
+    uint64_t t = 0;
+    for (unsigned i=0; i<s->nbuf; i++)
+      t |= (uint64_t)s->buf[i] << (8*i);
+    stream_block(s, t);
+  }
+
+  // Length padding
+  uint64_t state = s->state + s->len;
+  state = mul611(state, s->hash_key);
+
+  // Finalization: Encrypt H||N
+  MAC611_PROBE1(final, s->len);
+  state = REDUCE_611(state) + (1ULL<<63);
+  uint8_t S[16] = { write64(state) };
+  memcpy(S+8, nonce, 8);
+  Noekeon_encrypt(s->context->noekeon_key, S, S);
+
+  memcpy(tag, S, 8);
+  STATS_TAG(s->len, s->k);
+  MAC611_PROBE1(tag_exit, s->len);
+}
+
+
+/*
+ * Tag verification: the tags are compared in constant time
+ */
+int MAC611_verify (const struct MAC611_context * context, const uint8_t * M, size_t len, const uint8_t nonce[8], const uint8_t tag[8]) {
+  uint8_t t[8];
+  MAC611_tag(context, M, len, nonce, t);
+  return MAC611_tag_equal(t, tag);
+}
+
+
+/*
+ * Four messages at once
+ * The hash keys only depend on the block index: the full blocks
+ * common to the four messages are hashed in lockstep, with one
+ * rekey for the four, and the multiplications of the four chains
+ * overlap. The rest of each message is hashed on its own.
+ */
+void MAC611_tag_x4 (const struct MAC611_context * context, const uint8_t * const M[4], const size_t len[4],
+		    const uint8_t * const nonce[4], uint8_t * const tag[4]) {
+  uint64_t state[4] = { 0, 0, 0, 0 };
+  uint64_t hash_key = context->hash_key;
+  int cnt = LAMBDA;
+  uint64_t k = 0;
+  for (int j=0; j<4; j++)
+    MAC611_PROBE1(tag_entry, len[j]);
+
+  size_t common = len[0];
+  for (int j=1; j<4; j++)
+    common = len[j] < common? len[j]: common;
+  common -= common % 7;
+
+  size_t l = 0;
+  for (; l<common; l+=7) {
+    for (int j=0; j<4; j++) {
+      state[j] += read56(M[j]+l);
+      state[j] = mul611(state[j], hash_key);
+    }
+
+    if (--cnt == 0) {
+      k++;
+      unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+      Noekeon_encrypt(context->noekeon_key, tmp, tmp);
+      hash_key = REDUCE_611(read64(tmp));
+      cnt = LAMBDA;
+      MAC611_PROBE1(rekey, k);
+    }
+  }
+  STATS_REKEYS(k);
+
+  for (int j=0; j<4; j++) {
+    uint64_t s = state[j], key = hash_key, kj = k;
+    int c = cnt;
+    for (size_t lj=l; lj<len[j]; lj+=7) {
+      uint64_t t = 0;
+      for (int i=0; i<7 && lj+i<len[j]; i++)
+	t |= (uint64_t)M[j][lj+i] << (8*i);
+
+      s += t;
+      s = mul611(s, key);
+
+      if (--c == 0) {
+	kj++;
+	unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(kj) };
+	Noekeon_encrypt(context->noekeon_key, tmp, tmp);
+	key = REDUCE_611(read64(tmp));
+	c = LAMBDA;
+	MAC611_PROBE1(rekey, kj);
+      }
+    }
+
+    // Length padding
+    s += len[j];
+    s = mul611(s, key);
+
+    // Finalization: Encrypt H||N
+    MAC611_PROBE1(final, len[j]);
+    s = REDUCE_611(s) + (1ULL<<63);
+    uint8_t S[16] = { write64(s) };
+    memcpy(S+8, nonce[j], 8);
+    Noekeon_encrypt(context->noekeon_key, S, S);
+
+    memcpy(tag[j], S, 8);
+    STATS_TAG(len[j], kj-k); // Own rekeys only
+    MAC611_PROBE1(tag_exit, len[j]);
+  }
 }
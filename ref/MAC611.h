@@ -1,3 +1,6 @@
+#ifndef MAC611_H
+#define MAC611_H
+
 #include <stdint.h>
 #include <stddef.h>
 
@@ -17,6 +20,15 @@ void Noekeon_decrypt(const unsigned char * const key,
                    const unsigned char * const ciphertext,
                    unsigned char * const plaintext);
 
+void Noekeon_encrypt_start(struct Noekeon_state * const s,
+                   const unsigned char * const key,
+                   const unsigned char * const plaintext);
+
+void Noekeon_encrypt_round(struct Noekeon_state * const s);
+
+void Noekeon_encrypt_finish(struct Noekeon_state * const s,
+                   unsigned char * const ciphertext);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,12 +37,31 @@ void Noekeon_decrypt(const unsigned char * const key,
 /*** MAC611 interface ***/
 
 #define MOD611 ((1ULL<<61)-1)
+#define LAMBDA 1024 // Nb of blocks per key.
 
 struct MAC611_context {
   uint64_t hash_key;
   uint8_t noekeon_key[16];
 };
 
+#ifdef MAC611_REF
+// Only in ref/MAC611.c (the ARM ports share this header): defined by
+// the ref Makefile, so that callers on a port fail at compile time
+
+// Incremental tagging: MAC611_update can be called with any split
+// of the message, the pending partial block and key lifetime are kept
+struct MAC611_stream {
+  const struct MAC611_context * context;
+  uint64_t state;
+  uint64_t hash_key;
+  uint64_t k;       // Key index
+  uint64_t len;     // Bytes so far
+  int cnt;          // Key lifetime
+  unsigned nbuf;    // Bytes of the pending block
+  uint8_t buf[7];
+};
+#endif // MAC611_REF
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -38,8 +69,58 @@ extern char MUL_IMPLEM[];
 
 void MAC611_init (struct MAC611_context * context, const uint8_t k[16]);
 void MAC611_tag (const struct MAC611_context * context, const uint8_t * m, size_t len, const uint8_t nonce[8], uint8_t tag[8]);
-/* uint64_t mul611(uint64_t x, uint64_t y); */
-/* uint64_t REDUCE_611(uint64_t x); */
+#ifdef MAC611_REF
+void MAC611_start (struct MAC611_stream * s, const struct MAC611_context * context);
+void MAC611_update (struct MAC611_stream * s, const uint8_t * m, size_t len);
+void MAC611_finish (struct MAC611_stream * s, const uint8_t nonce[8], uint8_t tag[8]);
+#endif
+// 1 if tag is the tag of m, 0 otherwise (constant-time comparison)
+int  MAC611_verify (const struct MAC611_context * context, const uint8_t * m, size_t len, const uint8_t nonce[8], const uint8_t tag[8]);
+#ifdef MAC611_REF
+// Tags of 4 messages, their common blocks hashed in lockstep
+// (4 independent multiplication chains sharing the keys)
+void MAC611_tag_x4 (const struct MAC611_context * context, const uint8_t * const m[4], const size_t len[4],
+		    const uint8_t * const nonce[4], uint8_t * const tag[4]);
+#endif
+/* mul611() and REDUCE_611() are inline functions in mul611.h */
+
+// 1 if the tags a and b are equal, in constant time (for tags
+// computed apart, e.g. by MAC611_tag_x4 or a stream)
+static inline int MAC611_tag_equal (const uint8_t a[8], const uint8_t b[8]) {
+  uint8_t d = 0;
+  for (int i=0; i<8; i++)
+    d |= a[i] ^ b[i];
+  return d == 0;
+}
+
+#ifdef MAC611_STATS
+/*** Instrumentation (compile with -DMAC611_STATS), process-wide totals ***/
+#define MAC611_STATS_SIZES 65
+struct MAC611_stats {
+  uint64_t inits;   // MAC611_init calls
+  uint64_t finals;  // MAC611_tag calls (one finalization each)
+  uint64_t bytes;   // Message bytes
+  uint64_t blocks;  // 7-byte blocks (the partial block included)
+  uint64_t rekeys;  // LAMBDA boundary crossings
+  uint64_t noekeon; // Noekeon encryptions (init, rekeys, finalizations)
+  uint64_t sizes[MAC611_STATS_SIZES]; // Messages with 2^(i-1) <= len < 2^i (i=0: empty)
+};
+
+void MAC611_get_stats (struct MAC611_stats * stats);
+#endif
+
+#ifdef MAC611_PROFILE
+/*** Per-stage ticks of MAC611_tag (compile with -DMAC611_PROFILE), calling thread ***/
+enum { MAC611_STAGE_LOAD, MAC611_STAGE_MUL, MAC611_STAGE_REKEY, MAC611_STAGE_FINAL, MAC611_STAGES };
+struct MAC611_profile {
+  uint64_t calls;
+  uint64_t ticks[MAC611_STAGES];     // Including one timestamp read per interval
+  uint64_t intervals[MAC611_STAGES]; // Timed intervals
+};
+
+void MAC611_get_profile (struct MAC611_profile * profile);
+void MAC611_reset_profile (void);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -64,3 +145,5 @@ void MAC611_tag (const struct MAC611_context * context, const uint8_t * m, size_
     (uint8_t)((p)>>16), (uint8_t)((p)>>24),				\
     (uint8_t)((p)>>32), (uint8_t)((p)>>40),				\
     (uint8_t)((p)>>48), (uint8_t)((p)>>56)
+
+#endif // MAC611_H
@@ -0,0 +1,237 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Compile-time key material (C++17)
+ * (c) 2018-2019 XXXX
+ *
+ * constexpr versions of Noekeon encryption (direct-key mode, as in
+ * Noekeon.c) and of the key setup, so that a fixed key can be turned
+ * into constant data placed in .rodata/flash:
+ * - mac611::hash_key(key, k): k-th hash key (k = 0 is the first one)
+ * - mac611::hash_keys<R>(key): rekey schedule (keys 0..R-1)
+ * - mac611::make_context<Ctx>(key): MAC611_context (hash_key and
+ *   noekeon_key), for the reference and assembly implementations
+ * - mac611::mul_tables<BITS, R>(key): multiplication tables of keys
+ *   0..R-1 in the layout of arm-tables (R = TABLE_CACHE+1), and
+ *   mac611::make_table_context<Ctx>(key, tables) to point an
+ *   arm-tables context to them.
+ *
+ * This header does not include MAC611.h, so that it can be used with
+ * the MAC611.h of any implementation.
+ *
+ * Example (reference implementation):
+ *   constexpr mac611::key_t K = { 0x01, 0x23, ... };
+ *   constexpr MAC611_context ctx = mac611::make_context<MAC611_context>(K);
+ * Example (arm-tables):
+ *   static constexpr auto T = mac611::mul_tables<TABLE_BITS, TABLE_CACHE+1>(K);
+ *   constexpr MAC611_context ctx = mac611::make_table_context<MAC611_context>(K, T);
+ ************************************************************/
+
+#ifndef MAC611_CONSTEXPR_HPP
+#define MAC611_CONSTEXPR_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mac611 {
+
+struct key_t {
+  uint8_t b[16];
+  constexpr uint8_t operator[] (size_t i) const { return b[i]; }
+};
+
+struct block_t {
+  uint8_t b[16];
+  constexpr uint8_t operator[] (size_t i) const { return b[i]; }
+};
+
+namespace ce {
+
+constexpr uint64_t MOD = (1ULL<<61)-1;
+
+constexpr uint32_t rotl32(uint32_t v, unsigned n) {
+  return (v << n) | (v >> (32-n));
+}
+
+constexpr uint32_t load_be32(const uint8_t * p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+struct state_t { uint32_t a[4]; };
+
+constexpr void theta(const uint32_t k[4], uint32_t a[4]) {
+  uint32_t tmp = a[0]^a[2];
+  tmp ^= rotl32(tmp,8)^rotl32(tmp,24);
+  a[1] ^= tmp;
+  a[3] ^= tmp;
+
+  a[0] ^= k[0]; a[1] ^= k[1]; a[2] ^= k[2]; a[3] ^= k[3];
+
+  tmp = a[1]^a[3];
+  tmp ^= rotl32(tmp,8)^rotl32(tmp,24);
+  a[0] ^= tmp;
+  a[2] ^= tmp;
+}
+
+constexpr void gamma(uint32_t a[4]) {
+  a[1] ^= ~a[3] & ~a[2];
+  a[0] ^=  a[2] &  a[1];
+
+  uint32_t tmp = a[3];
+  a[3] = a[0];
+  a[0] = tmp;
+  a[2] ^= a[0]^a[1]^a[3];
+
+  a[1] ^= ~a[3] & ~a[2];
+  a[0] ^=  a[2] &  a[1];
+}
+
+// Same as Noekeon_encrypt (16 rounds, direct-key mode)
+constexpr block_t noekeon_encrypt(const key_t & key, const block_t & pt) {
+  uint32_t k[4] = { load_be32(key.b), load_be32(key.b+4), load_be32(key.b+8), load_be32(key.b+12) };
+  uint32_t a[4] = { load_be32(pt.b),  load_be32(pt.b+4),  load_be32(pt.b+8),  load_be32(pt.b+12)  };
+  uint8_t rc1 = 0x80, rc2 = 0;
+
+  for (int i=0; i<16; i++) {
+    a[0] ^= rc1;
+    theta(k, a);
+    a[0] ^= rc2;
+    a[1] = rotl32(a[1], 1); a[2] = rotl32(a[2], 5); a[3] = rotl32(a[3], 2);
+    gamma(a);
+    a[1] = rotl32(a[1], 31); a[2] = rotl32(a[2], 27); a[3] = rotl32(a[3], 30);
+    rc1 = (rc1 & 0x80)? (uint8_t)((rc1 << 1) ^ 0x1B): (uint8_t)(rc1 << 1);
+    rc2 = (rc2 & 0x01)? (uint8_t)((rc2 >> 1) ^ 0x8D): (uint8_t)(rc2 >> 1);
+  }
+  a[0] ^= rc1;
+  theta(k, a);
+  a[0] ^= rc2;
+
+  block_t ct = {};
+  for (int i=0; i<4; i++)
+    for (int j=0; j<4; j++)
+      ct.b[4*i+j] = (uint8_t)(a[i] >> (24-8*j));
+  return ct;
+}
+
+// Reduce from [0 .. 2^62-2] to [0 .. 2^61-1], as in arm-tables
+constexpr uint64_t reduce_mini(uint64_t x) {
+  return x > MOD? x-MOD: x;
+}
+
+} // namespace ce
+
+using ce::noekeon_encrypt;
+
+/*
+ * Hash key of index k: Noekeon_K(0^64 || k), little-endian, mod 2^61-1
+ */
+constexpr uint64_t hash_key(const key_t & key, uint64_t k) {
+  block_t in = {};
+  for (int i=0; i<8; i++)
+    in.b[8+i] = (uint8_t)(k >> (8*i));
+  block_t out = noekeon_encrypt(key, in);
+  uint64_t x = 0;
+  for (int i=0; i<8; i++)
+    x |= (uint64_t)out.b[i] << (8*i);
+  return x % ce::MOD;
+}
+
+template <size_t R>
+struct hash_keys_t { uint64_t k[R]; };
+
+template <size_t R>
+constexpr hash_keys_t<R> hash_keys(const key_t & key) {
+  hash_keys_t<R> s = {};
+  for (size_t i=0; i<R; i++)
+    s.k[i] = hash_key(key, i);
+  return s;
+}
+
+/*
+ * Context of the reference (and assembly) implementations
+ */
+template <class Ctx>
+constexpr Ctx make_context(const key_t & key) {
+  Ctx ctx = {};
+  ctx.hash_key = hash_key(key, 0);
+  for (int i=0; i<16; i++)
+    ctx.noekeon_key[i] = key[i];
+  return ctx;
+}
+
+/*
+ * Multiplication tables of arm-tables: R keys, 64/BITS windows of 2^BITS entries
+ * t[k][i][j] = j * 2^(BITS*i) * hash_key(k) mod 2^61-1, reduced to [0 .. 2^61-1]
+ */
+template <unsigned BITS, size_t R>
+struct mul_tables_t {
+  static constexpr unsigned WINDOWS = 64/BITS;
+  static constexpr unsigned SIZE = 1u<<BITS;
+  uint64_t t[R][WINDOWS][SIZE];
+};
+
+template <unsigned BITS, size_t R>
+constexpr mul_tables_t<BITS, R> mul_tables(const key_t & key) {
+  using T = mul_tables_t<BITS, R>;
+  T mt = {};
+  for (size_t k=0; k<R; k++) {
+    for (unsigned i=0; i<T::WINDOWS; i++) {
+      mt.t[k][i][1] = i == 0? hash_key(key, k): ce::reduce_mini(2*mt.t[k][i-1][T::SIZE/2]);
+      for (unsigned j=2; j<T::SIZE; j++)
+	mt.t[k][i][j] = ce::reduce_mini(mt.t[k][i][j-1]+mt.t[k][i][1]);
+    }
+  }
+  return mt;
+}
+
+/*
+ * Context of arm-tables using constant tables (keys 0..TABLE_CACHE)
+ * The tables are never written: the context can be constexpr as well.
+ * It has no scratch tables: messages using keys above TABLE_CACHE
+ * take theirs from the heap (or use MAC611_tag_scratch).
+ */
+template <class Ctx, unsigned BITS, size_t R>
+constexpr Ctx make_table_context(const key_t & key, const mul_tables_t<BITS, R> & tables) {
+  Ctx ctx = {};
+  ctx.hash_key = hash_key(key, 0);
+  for (int i=0; i<16; i++)
+    ctx.noekeon_key[i] = key[i];
+  ctx.mul_table = tables.t;
+  ctx.scratch = nullptr;
+  ctx.alloc = nullptr;
+  return ctx;
+}
+
+/*
+ * Compile-time checks against the Noekeon test vectors (Noekeon.c)
+ */
+namespace ce {
+constexpr bool equal(const block_t & a, const block_t & b) {
+  for (int i=0; i<16; i++)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+
+static_assert(equal(noekeon_encrypt(key_t{}, block_t{}),
+		    block_t{{0xb1, 0x65, 0x68, 0x51, 0x69, 0x9e, 0x29, 0xfa,
+			     0x24, 0xb7, 0x01, 0x48, 0x50, 0x3d, 0x2d, 0xfc}}),
+	      "Noekeon test vector (zero key)");
+static_assert(equal(noekeon_encrypt(key_t{{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+					   0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}},
+				    block_t{{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+					     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}}),
+		    block_t{{0x2a, 0x78, 0x42, 0x1b, 0x87, 0xc7, 0xd0, 0x92,
+			     0x4f, 0x26, 0x11, 0x3f, 0x1d, 0x13, 0x49, 0xb2}}),
+	      "Noekeon test vector (all-ones key)");
+static_assert(equal(noekeon_encrypt(key_t{{0xb1, 0x65, 0x68, 0x51, 0x69, 0x9e, 0x29, 0xfa,
+					   0x24, 0xb7, 0x01, 0x48, 0x50, 0x3d, 0x2d, 0xfc}},
+				    block_t{{0x2a, 0x78, 0x42, 0x1b, 0x87, 0xc7, 0xd0, 0x92,
+					     0x4f, 0x26, 0x11, 0x3f, 0x1d, 0x13, 0x49, 0xb2}}),
+		    block_t{{0xe2, 0xf6, 0x87, 0xe0, 0x7b, 0x75, 0x66, 0x0f,
+			     0xfc, 0x37, 0x22, 0x33, 0xbc, 0x47, 0x53, 0x2c}}),
+	      "Noekeon test vector (chained)");
+} // namespace ce
+
+} // namespace mac611
+
+#endif // MAC611_CONSTEXPR_HPP
@@ -0,0 +1,318 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Policy-based hash engine (C++17, header only)
+ * (c) 2018-2019 XXXX
+ *
+ * mac611::engine<Loader, Mul, Reduction, Unroll, Lanes> computes the
+ * same tag as MAC611_tag, with each implementation choice of the
+ * other versions as a policy:
+ * - Loader: how 7-byte blocks are read
+ *     load_byte  byte by byte (as ref/MAC611.c)
+ *     load_word  8-byte loads and a mask
+ *     load_simd  16-byte loads and a shuffle (SSSE3, else load_word)
+ * - Mul: multiplication mod 2^61-1
+ *     mul_int128 64x64->128 multiplier (GCC int128)
+ *     mul_limb32 32x32->64 multiplier (generic C version)
+ *     mul_base31 Karatsuba in base 2^31 (as armv6M-small)
+ *     mul_table  8-bit window tables, no multiplier (as arm-tables)
+ * - Reduction: when products are reduced
+ *     reduce_eager after each product
+ *     reduce_lazy  once per group of Lanes products
+ * - Unroll: groups of blocks per loop iteration
+ * - Lanes: blocks per group; a group is evaluated with the powers
+ *   k^Lanes .. k^1 of the hash key, so that its products are
+ *   independent: (h + m1) k^L + m2 k^(L-1) + ... + mL k
+ *
+ * Intermediate values are kept below 2^62 (inputs of Mul), and
+ * products are accumulated in 128 bits (struct u128 when the
+ * policy does not use __int128).
+ ************************************************************/
+
+#ifndef MAC611_ENGINE_HPP
+#define MAC611_ENGINE_HPP
+
+#include <string.h>
+#include "MAC611.h"
+#include "mul611.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace mac611 {
+
+namespace detail {
+
+constexpr uint64_t MASK56 = 0x00ffffffffffffffULL;
+
+// Partial reduction to [0 .. 2^61+6]
+static inline uint64_t fold(uint64_t x) {
+  return (x&MOD611) + (x>>61);
+}
+
+// Unreduced sum of products (< 2^127)
+struct u128 {
+  uint64_t lo, hi;
+};
+
+static inline u128 add(u128 a, u128 b) {
+  u128 r = { a.lo+b.lo, a.hi+b.hi };
+  r.hi += r.lo < a.lo;
+  return r;
+}
+
+// 2^64 = 8 mod 2^61-1
+static inline uint64_t reduce128(uint64_t lo, uint64_t hi) {
+  uint64_t t = (lo&MOD611) + (lo>>61) + ((hi&((1ULL<<58)-1))<<3) + (hi>>58);
+  return fold(t);
+}
+
+} // namespace detail
+
+/*** Loaders: Count blocks of 7 bytes, at least 8 readable bytes after the last one ***/
+
+struct load_byte {
+  static constexpr const char * name = "byte";
+  template <unsigned Count>
+  static inline void blocks(const uint8_t * p, uint64_t m[Count]) {
+    for (unsigned j=0; j<Count; j++, p+=7) {
+      uint64_t t = 0;
+      for (int i=0; i<7; i++)
+	t |= (uint64_t)p[i] << (8*i);
+      m[j] = t;
+    }
+  }
+};
+
+struct load_word {
+  static constexpr const char * name = "word";
+  template <unsigned Count>
+  static inline void blocks(const uint8_t * p, uint64_t m[Count]) {
+    for (unsigned j=0; j<Count; j++, p+=7)
+      m[j] = read64(p) & detail::MASK56;
+  }
+};
+
+#if defined(__SSSE3__)
+struct load_simd {
+  static constexpr const char * name = "simd";
+  template <unsigned Count>
+  static inline void blocks(const uint8_t * p, uint64_t m[Count]) {
+    // Two blocks per 16-byte load: bytes 0..6 and 7..13, zero-extended
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, -1, 7, 8, 9, 10, 11, 12, 13, -1);
+    unsigned j = 0;
+    for (; j+2<=Count; j+=2, p+=14) {
+      __m128i x = _mm_loadu_si128((const __m128i*)p);
+      _mm_storeu_si128((__m128i*)(m+j), _mm_shuffle_epi8(x, shuf));
+    }
+    if (j < Count)
+      m[j] = read64(p) & detail::MASK56;
+  }
+};
+#else
+struct load_simd : load_word {
+  static constexpr const char * name = "simd(word)";
+};
+#endif
+
+/*** Multiplications: mul(x, key) with x < 2^62, as a wide value for accumulation ***/
+
+#ifdef __SIZEOF_INT128__
+struct mul_int128 {
+  static constexpr const char * name = "int128";
+  typedef uint64_t key_t;
+  typedef unsigned __int128 wide_t;
+  static inline void prepare(key_t & key, uint64_t k) { key = k; }
+  static inline wide_t zero() { return 0; }
+  static inline wide_t mul(uint64_t x, const key_t & key) { return (wide_t)x*key; }
+  static inline wide_t add(wide_t a, wide_t b) { return a+b; }
+  static inline uint64_t reduce(wide_t z) { return detail::reduce128((uint64_t)z, (uint64_t)(z>>64)); }
+};
+#endif
+
+struct mul_limb32 {
+  static constexpr const char * name = "limb32";
+  typedef uint64_t key_t;
+  typedef detail::u128 wide_t;
+  static inline void prepare(key_t & key, uint64_t k) { key = k; }
+  static inline wide_t zero() { return wide_t{0, 0}; }
+  static inline wide_t mul(uint64_t x, const key_t & y) {
+    uint64_t xl = (uint32_t)x, xh = x>>32;
+    uint64_t yl = (uint32_t)y, yh = y>>32;
+    uint64_t ll = xl*yl, hh = xh*yh;
+    uint64_t mid = xh*yl + xl*yh;  // < 2^63 (x < 2^62, y < 2^61)
+    wide_t r = { ll + (mid<<32), hh + (mid>>32) };
+    r.hi += r.lo < ll;
+    return r;
+  }
+  static inline wide_t add(wide_t a, wide_t b) { return detail::add(a, b); }
+  static inline uint64_t reduce(wide_t z) { return detail::reduce128(z.lo, z.hi); }
+};
+
+struct mul_base31 {
+  static constexpr const char * name = "base31";
+  struct key_t { uint32_t l, h; };
+  typedef detail::u128 wide_t;
+  static inline void prepare(key_t & key, uint64_t k) { key.l = k & 0x7fffffff; key.h = k>>31; }
+  static inline wide_t zero() { return wide_t{0, 0}; }
+  static inline wide_t mul(uint64_t x, const key_t & y) {
+    // Karatsuba with 31-bit halves: x*y = M0 + K 2^31 + M1 2^62, and 2^62 = 2
+    uint32_t xl = x & 0x7fffffff, xh = x>>31;
+    uint64_t M0 = (uint64_t)xl*y.l;
+    uint64_t M1 = (uint64_t)xh*y.h;
+    uint64_t K  = (uint64_t)(xl+xh)*(y.l+y.h) - M0 - M1;
+    // K 2^31 = (K mod 2^30) 2^31 + (K >> 30) 2^61
+    uint64_t t = M0 + ((K & 0x3fffffff) << 31) + (K>>30) + 2*M1;
+    return wide_t{t, 0};
+  }
+  static inline wide_t add(wide_t a, wide_t b) { return detail::add(a, b); }
+  static inline uint64_t reduce(wide_t z) { return detail::reduce128(z.lo, z.hi); }
+};
+
+struct mul_table {
+  static constexpr const char * name = "table";
+  // t[i][j] = j 2^(8i) k, reduced to [0 .. 2^61-1]
+  struct key_t { uint64_t t[8][256]; };
+  typedef detail::u128 wide_t;
+  static inline void prepare(key_t & key, uint64_t k) {
+    for (int i=0; i<8; i++) {
+      key.t[i][0] = 0;
+      key.t[i][1] = i == 0? k: detail::fold(2*key.t[i-1][128]);
+      if (key.t[i][1] > MOD611)
+	key.t[i][1] -= MOD611;
+      for (int j=2; j<256; j++) {
+	uint64_t v = key.t[i][j-1]+key.t[i][1];
+	key.t[i][j] = v > MOD611? v-MOD611: v;
+      }
+    }
+  }
+  static inline wide_t zero() { return wide_t{0, 0}; }
+  static inline wide_t mul(uint64_t x, const key_t & key) {
+    uint64_t s = 0;
+    for (int i=0; i<8; i++)
+      s += key.t[i][(x >> (8*i)) & 0xff];
+    return wide_t{s, 0};
+  }
+  static inline wide_t add(wide_t a, wide_t b) { return detail::add(a, b); }
+  static inline uint64_t reduce(wide_t z) { return detail::reduce128(z.lo, z.hi); }
+};
+
+/*** Reductions: evaluation of one group (h + m1) k^L + ... + mL k ***/
+
+struct reduce_eager {
+  static constexpr const char * name = "eager";
+  template <class Mul, unsigned L>
+  static inline uint64_t group(uint64_t h, const uint64_t m[L], const typename Mul::key_t pw[L]) {
+    uint64_t acc = Mul::reduce(Mul::mul(h+m[0], pw[L-1]));
+    for (unsigned j=1; j<L; j++)
+      acc = detail::fold(acc + Mul::reduce(Mul::mul(m[j], pw[L-1-j])));
+    return acc;
+  }
+};
+
+struct reduce_lazy {
+  static constexpr const char * name = "lazy";
+  template <class Mul, unsigned L>
+  static inline uint64_t group(uint64_t h, const uint64_t m[L], const typename Mul::key_t pw[L]) {
+    typename Mul::wide_t acc = Mul::mul(h+m[0], pw[L-1]);
+    for (unsigned j=1; j<L; j++)
+      acc = Mul::add(acc, Mul::mul(m[j], pw[L-1-j]));
+    return Mul::reduce(acc);
+  }
+};
+
+/*** Engine ***/
+
+template <class Loader, class Mul, class Reduction, unsigned Unroll, unsigned Lanes>
+struct engine {
+  static_assert(Unroll >= 1 && Lanes >= 1 && Lanes <= 8, "1 <= Lanes <= 8");
+
+  // pw[j] = k^(j+1)
+  static inline void powers(typename Mul::key_t pw[Lanes], uint64_t k) {
+    uint64_t kj = k;
+    for (unsigned j=0; j<Lanes; j++) {
+      Mul::prepare(pw[j], kj);
+      kj = REDUCE_611(mul611(kj, k));
+    }
+  }
+
+  static inline uint64_t next_key(const struct MAC611_context * ctx, uint64_t k) {
+    unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+    Noekeon_encrypt(ctx->noekeon_key, tmp, tmp);
+    return REDUCE_611(read64(tmp));
+  }
+
+  // Single block with key k^1
+  static inline uint64_t step(uint64_t h, uint64_t m, const typename Mul::key_t pw[Lanes]) {
+    return Mul::reduce(Mul::mul(h+m, pw[0]));
+  }
+
+  // Universal hash, fully reduced
+  static uint64_t hash(const struct MAC611_context * ctx, const uint8_t * M, size_t len) {
+    constexpr unsigned G = Unroll*Lanes; // Blocks per iteration
+    typename Mul::key_t pw[Lanes];
+    powers(pw, ctx->hash_key);
+
+    uint64_t h = 0;
+    uint64_t k = 0;                 // Key index
+    size_t full = len/7;            // Full blocks
+    // Blocks that can be read by groups (8 bytes after each group)
+    size_t fast = len >= 8? (len-8)/7: 0;
+    size_t i = 0;
+
+    while (i < full) {
+      size_t end = (k+1)*LAMBDA < full? (k+1)*LAMBDA: full;
+      size_t gend = end < fast? end: fast;
+
+      for (; i+G<=gend; i+=G) {
+#pragma GCC unroll 8
+	for (unsigned u=0; u<Unroll; u++) {
+	  uint64_t m[Lanes];
+	  Loader::template blocks<Lanes>(M+7*(i+u*Lanes), m);
+	  h = Reduction::template group<Mul, Lanes>(h, m, pw);
+	}
+      }
+      for (; i+Lanes<=gend; i+=Lanes) {
+	uint64_t m[Lanes];
+	Loader::template blocks<Lanes>(M+7*i, m);
+	h = Reduction::template group<Mul, Lanes>(h, m, pw);
+      }
+      for (; i<end; i++) {
+	uint64_t m;
+	load_byte::blocks<1>(M+7*i, &m);
+	h = step(h, m, pw);
+      }
+
+      if (i == (k+1)*LAMBDA)
+	powers(pw, next_key(ctx, ++k));
+    }
+
+    // Partial last block (also counts towards the key lifetime)
+    if (len%7) {
+      uint64_t t = 0;
+      for (size_t j=0; j<len%7; j++)
+	t |= (uint64_t)M[7*full+j] << (8*j);
+      h = step(h, t, pw);
+      if ((full+1)%LAMBDA == 0)
+	powers(pw, next_key(ctx, ++k));
+    }
+
+    // Length padding
+    h = step(h, len, pw);
+    return REDUCE_611(h);
+  }
+
+  static void tag(const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+    uint64_t state = hash(ctx, M, len) + (1ULL<<63);
+
+    // Finalization: Encrypt H||N
+    uint8_t S[16] = { write64(state) };
+    memcpy(S+8, nonce, 8);
+    Noekeon_encrypt(ctx->noekeon_key, S, S);
+    memcpy(tag, S, 8);
+  }
+};
+
+} // namespace mac611
+
+#endif // MAC611_ENGINE_HPP
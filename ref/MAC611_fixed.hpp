@@ -0,0 +1,135 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Length-specialized tag evaluation (C++17)
+ * (c) 2018-2019 XXXX
+ *
+ * mac611::tag_fixed<N> computes the same tag as MAC611_tag for
+ * messages of exactly N bytes, with everything that depends on the
+ * length resolved at compile time:
+ * - short messages (up to UNROLL_MAX blocks) are fully unrolled,
+ * - blocks are read with 8-byte loads and a constant mask/shift
+ *   (the last block is read backwards from the end of the message),
+ * - the rekey logic is only generated when N needs it,
+ * - the length padding is a constant.
+ *
+ * mac611::tag dispatches common record sizes to tag_fixed, and
+ * other lengths to MAC611_tag.
+ ************************************************************/
+
+#ifndef MAC611_FIXED_HPP
+#define MAC611_FIXED_HPP
+
+#include <string.h>
+#include "MAC611.h"
+#include "mul611.h"
+
+namespace mac611 {
+
+// Messages of up to UNROLL_MAX blocks are fully unrolled (no rekey, UNROLL_MAX < LAMBDA)
+constexpr size_t UNROLL_MAX = 128;
+static_assert(UNROLL_MAX < LAMBDA, "unrolled messages must use a single key");
+
+namespace detail {
+
+// Block starting at byte Off of an N-byte message (7 bytes, or less for the last one)
+template <size_t N, size_t Off>
+static inline __attribute__((always_inline)) uint64_t load(const uint8_t * m) {
+  constexpr size_t n = N-Off < 7? N-Off: 7;
+  if constexpr (Off+8 <= N) {
+    return read64(m+Off) & 0x00ffffffffffffffULL;
+  } else if constexpr (N >= 8) {
+    // Last block: load the final 8 bytes and drop the ones before Off
+    return read64(m+N-8) >> (64-8*n);
+  } else {
+    uint64_t t = 0;
+    for (size_t i=0; i<n; i++)
+      t |= (uint64_t)m[Off+i] << (8*i);
+    return t;
+  }
+}
+
+// Horner evaluation of blocks I..End-1, unrolled at compile time
+template <size_t N, size_t I, size_t End>
+static inline __attribute__((always_inline)) uint64_t hash_unrolled(uint64_t state, uint64_t key, const uint8_t * m) {
+  if constexpr (I == End) {
+    return state;
+  } else {
+    state = mul611(state + load<N, 7*I>(m), key);
+    return hash_unrolled<N, I+1, End>(state, key, m);
+  }
+}
+
+// Hash key of index k
+static inline uint64_t next_key(const struct MAC611_context * ctx, uint64_t k) {
+  unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+  Noekeon_encrypt(ctx->noekeon_key, tmp, tmp);
+  return REDUCE_611(read64(tmp));
+}
+
+} // namespace detail
+
+/*
+ * MAC611 tag evaluation for messages of exactly N bytes
+ * The context should be initialized using MAC611_init.
+ */
+template <size_t N>
+inline void tag_fixed (const struct MAC611_context * ctx, const uint8_t * M, const uint8_t nonce[8], uint8_t tag[8]) {
+  constexpr size_t full = N/7;                 // Full blocks
+  constexpr size_t blocks = full + (N%7 != 0); // Including the partial block
+  uint64_t hash_key = ctx->hash_key;
+  uint64_t state = 0;
+
+  if constexpr (blocks <= UNROLL_MAX) {
+    state = detail::hash_unrolled<N, 0, blocks>(state, hash_key, M);
+  } else {
+    // 8-byte loads are safe for all blocks but the last one of the message
+    // (constant trip counts: whole key chunks, then the rest)
+    constexpr size_t safe = N%7? full: full-1;
+    constexpr size_t chunks = safe/LAMBDA, rest = safe%LAMBDA;
+    uint64_t k = 0;
+    const uint8_t * p = M;
+    for (size_t c=0; c<chunks; c++) {
+      for (size_t j=0; j<LAMBDA; j++, p+=7)
+	state = mul611(state + (read64(p) & 0x00ffffffffffffffULL), hash_key);
+      hash_key = detail::next_key(ctx, ++k);
+    }
+    for (size_t j=0; j<rest; j++, p+=7)
+      state = mul611(state + (read64(p) & 0x00ffffffffffffffULL), hash_key);
+
+    // Last block, and rekey if it ends a chunk
+    state = mul611(state + detail::load<N, 7*(blocks-1)>(M), hash_key);
+    if constexpr (blocks%LAMBDA == 0)
+      hash_key = detail::next_key(ctx, ++k);
+  }
+
+  // Length padding
+  state = mul611(state + N, hash_key);
+
+  // Finalization: Encrypt H||N
+  state = REDUCE_611(state) + (1ULL<<63);
+  uint8_t S[16] = { write64(state) };
+  memcpy(S+8, nonce, 8);
+  Noekeon_encrypt(ctx->noekeon_key, S, S);
+
+  memcpy(tag, S, 8);
+}
+
+/*
+ * MAC611 tag evaluation, specialized for common record sizes
+ */
+inline void tag (const struct MAC611_context * ctx, const uint8_t * M, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+  switch (len) {
+  case 16:  tag_fixed<16> (ctx, M, nonce, tag); break;
+  case 32:  tag_fixed<32> (ctx, M, nonce, tag); break;
+  case 48:  tag_fixed<48> (ctx, M, nonce, tag); break;
+  case 64:  tag_fixed<64> (ctx, M, nonce, tag); break;
+  case 128: tag_fixed<128>(ctx, M, nonce, tag); break;
+  case 256: tag_fixed<256>(ctx, M, nonce, tag); break;
+  case 512: tag_fixed<512>(ctx, M, nonce, tag); break;
+  default:  MAC611_tag(ctx, M, len, nonce, tag); break;
+  }
+}
+
+} // namespace mac611
+
+#endif // MAC611_FIXED_HPP
@@ -0,0 +1,68 @@
+/************************************************************
+ * MAC611 reference implementation
+ * USDT static tracepoints
+ * (c) 2018-2019 XXXX
+ *
+ * SystemTap-compatible probes (provider "mac611"), usable with
+ * perf, bpftrace or stap without rebuilding, e.g.
+ *   bpftrace -e 'usdt:./bench:mac611:rekey { @[arg0] = count(); }'
+ * Each probe is a nop in the code and a .note.stapsdt entry giving
+ * its address and where its arguments are (same layout as
+ * <sys/sdt.h>, which is not required). Arguments are 64-bit.
+ *
+ * Probes are compiled on ELF targets with GCC-style inline assembly
+ * for x86-64 and AArch64 Linux; define MAC611_NO_PROBES to remove them.
+ ************************************************************/
+
+#ifndef MAC611_PROBES_H
+#define MAC611_PROBES_H
+
+#include <stdint.h>
+
+#if !defined(MAC611_NO_PROBES) && defined(__ELF__) && defined(__linux__) && \
+  (defined(__x86_64__) || defined(__aarch64__))
+
+#ifdef __aarch64__
+#define MAC611_PROBE_ARG "%x[a1]"
+#else
+#define MAC611_PROBE_ARG "%[a1]"
+#endif
+
+// Note header: namesz, descsz, type 3, "stapsdt"; descriptor: probe
+// address, base address (for prelink adjustment), semaphore (none),
+// provider, name, argument list "size@operand"
+#define MAC611_PROBE_NOTE(name, args)					\
+  "990:\tnop\n"								\
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"				\
+  ".balign 4\n"								\
+  ".4byte 992f-991f, 994f-993f, 3\n"					\
+  "991:\t.asciz \"stapsdt\"\n"						\
+  "992:\t.balign 4\n"							\
+  "993:\t.8byte 990b\n"							\
+  ".8byte _.stapsdt.base\n"						\
+  ".8byte 0\n"								\
+  ".asciz \"mac611\"\n"							\
+  ".asciz \"" #name "\"\n"						\
+  ".asciz \"" args "\"\n"						\
+  "994:\t.balign 4\n"							\
+  ".popsection\n"							\
+  ".ifndef _.stapsdt.base\n"						\
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+  ".weak _.stapsdt.base\n"						\
+  ".hidden _.stapsdt.base\n"						\
+  "_.stapsdt.base: .space 1\n"						\
+  ".size _.stapsdt.base, 1\n"						\
+  ".popsection\n"							\
+  ".endif\n"
+
+#define MAC611_PROBE1(name, a)						\
+  __asm__ __volatile__ (MAC611_PROBE_NOTE(name, "8@" MAC611_PROBE_ARG)	\
+			:: [a1] "nor" ((uint64_t)(a)))
+
+#else
+
+#define MAC611_PROBE1(name, a) do { } while (0)
+
+#endif
+
+#endif // MAC611_PROBES_H
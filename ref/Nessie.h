@@ -155,5 +155,14 @@ struct NESSIEstruct {
   u32 k[4];
 };
 
+/* State of an incremental encryption (NOEKEON_NROUND rounds) */
+#define NOEKEON_NROUND 16
+
+struct Noekeon_state {
+  u32 k[4];
+  u32 a[4];
+  u8 RC1, RC2;
+};
+
 #endif   /* PORTABLE_C__ */
 
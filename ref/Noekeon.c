@@ -225,6 +225,54 @@ void Noekeon_encrypt(const unsigned char * const key,
   U32TO8_BIG(ciphertext+12, state[3]);
 } /* Noekeon_encrypt */
 
+/*==================================================================================*/
+void Noekeon_encrypt_start(struct Noekeon_state * const s,
+                   const unsigned char * const key,
+                   const unsigned char * const plaintext)
+/*----------------------------------------------------------------------------------*/
+/* Incremental encryption: Noekeon_encrypt_start, then NROUND calls to
+ * Noekeon_encrypt_round, then Noekeon_encrypt_finish. Used to interleave the
+ * rounds with other computations.
+ *==================================================================================*/
+{
+  s->a[0]=U8TO32_BIG(plaintext   );
+  s->a[1]=U8TO32_BIG(plaintext+4 );
+  s->a[2]=U8TO32_BIG(plaintext+8 );
+  s->a[3]=U8TO32_BIG(plaintext+12);
+
+  s->k[0]=U8TO32_BIG(key   );
+  s->k[1]=U8TO32_BIG(key+4 );
+  s->k[2]=U8TO32_BIG(key+8 );
+  s->k[3]=U8TO32_BIG(key+12);
+
+  s->RC1 = RC1ENCRYPTSTART;
+  s->RC2 = 0;
+} /* Noekeon_encrypt_start */
+
+/*==================================================================================*/
+void Noekeon_encrypt_round(struct Noekeon_state * const s)
+/*==================================================================================*/
+{
+  Round(s->k,s->a,s->RC1,s->RC2);
+  RCShiftRegFwd(&s->RC1);
+  RCShiftRegBwd(&s->RC2);
+} /* Noekeon_encrypt_round */
+
+/*==================================================================================*/
+void Noekeon_encrypt_finish(struct Noekeon_state * const s,
+                   unsigned char * const ciphertext)
+/*==================================================================================*/
+{
+  s->a[0]^=s->RC1;
+  Theta(s->k,s->a);
+  s->a[0]^=s->RC2;
+
+  U32TO8_BIG(ciphertext   , s->a[0]);
+  U32TO8_BIG(ciphertext+4 , s->a[1]);
+  U32TO8_BIG(ciphertext+8 , s->a[2]);
+  U32TO8_BIG(ciphertext+12, s->a[3]);
+} /* Noekeon_encrypt_finish */
+
 /*==================================================================================*/
 void Noekeon_decrypt(const unsigned char * const key,
                    const unsigned char * const ciphertext,
@@ -0,0 +1,494 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * (c) 2018-2019 XXXX
+ *
+ * Usage: bench [mode] [options] [args]
+ * See usage() for the modes and options. Build with
+ *   make bench
+ * (no sanitizers, -O3 -march=native).
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "bench.h"
+
+/*** Environment ***/
+
+int bench_pin (int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set);
+#else
+  (void)cpu;
+  return -1;
+#endif
+}
+
+std::string bench_cpu_model (void) {
+  std::string model = "unknown";
+  FILE * f = fopen("/proc/cpuinfo", "r");
+  if (!f)
+    return model;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "model name", 10) == 0 && strchr(line, ':')) {
+      model = strchr(line, ':')+2;
+      model.erase(model.find_last_not_of(" \n")+1);
+      break;
+    }
+  }
+  fclose(f);
+  return model;
+}
+
+void bench_flush (const void * buf, size_t len) {
+#if defined(__x86_64__) || defined(__i386__)
+  const char * p = (const char *)buf;
+  for (size_t i=0; i<len; i+=64)
+    _mm_clflush(p+i);
+  if (len)
+    _mm_clflush(p+len-1);
+  _mm_mfence();
+#else
+  // Read a buffer larger than the last level cache
+  static volatile uint8_t * evict = NULL;
+  const size_t EVICT = 64<<20;
+  (void)buf; (void)len;
+  if (!evict)
+    evict = (volatile uint8_t *)calloc(EVICT, 1);
+  if (evict)
+    for (size_t i=0; i<EVICT; i+=64)
+      evict[i]++;
+#endif
+}
+
+/*** Statistics ***/
+
+bench_stats bench_compute (std::vector<uint64_t> & t) {
+  bench_stats s = { t.size(), 0, 0, 0, 0, 0 };
+  if (t.empty())
+    return s;
+  std::sort(t.begin(), t.end());
+  double sum = 0, sq = 0;
+  for (uint64_t x : t)
+    sum += x;
+  s.mean = sum / t.size();
+  for (uint64_t x : t)
+    sq += (x-s.mean)*(x-s.mean);
+  s.stddev = t.size() > 1? sqrt(sq/(t.size()-1)): 0;
+  s.min = t.front();
+  s.max = t.back();
+  s.median = t.size()%2? t[t.size()/2]: (t[t.size()/2-1]+t[t.size()/2])/2.0;
+  return s;
+}
+
+/*** Histogram ***/
+
+void bench_histogram::reset (void) {
+  count = 0;
+  max_value = 0;
+  memset(buckets, 0, sizeof(buckets));
+}
+
+void bench_histogram::merge (const bench_histogram & h) {
+  count += h.count;
+  max_value = std::max(max_value, h.max_value);
+  for (unsigned i=0; i<HIST_BUCKETS; i++)
+    buckets[i] += h.buckets[i];
+}
+
+uint64_t bench_histogram::lowest (unsigned i) {
+  if (i < (1u << HIST_SUB))
+    return i;
+  unsigned e = (i >> (HIST_SUB-1)) - 1;
+  uint64_t m = (i & ((1u << (HIST_SUB-1))-1)) + (1u << (HIST_SUB-1));
+  return m << e;
+}
+
+uint64_t bench_histogram::highest (unsigned i) {
+  return i+1 < HIST_BUCKETS? lowest(i+1)-1: ~0ULL;
+}
+
+uint64_t bench_histogram::quantile (double q) const {
+  if (!count)
+    return 0;
+  uint64_t rank = (uint64_t)ceil(q*count);
+  if (rank == 0)
+    rank = 1;
+  uint64_t n = 0;
+  for (unsigned i=0; i<HIST_BUCKETS; i++) {
+    n += buckets[i];
+    if (n >= rank)
+      return std::min(highest(i), max_value);
+  }
+  return max_value;
+}
+
+uint64_t bench_histogram::above (uint64_t v) const {
+  uint64_t n = 0;
+  for (unsigned i=index(v)+1; i<HIST_BUCKETS; i++)
+    n += buckets[i];
+  return n;
+}
+
+/*** Output ***/
+
+bench_field F (const char * name, const char * value) {
+  return bench_field{ name, value, false };
+}
+
+bench_field F (const char * name, const std::string & value) {
+  return bench_field{ name, value, false };
+}
+
+bench_field F (const char * name, uint64_t value) {
+  return bench_field{ name, std::to_string(value), true };
+}
+
+bench_field F (const char * name, double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.4f", value);
+  return bench_field{ name, buf, true };
+}
+
+static std::string json_string (const std::string & s) {
+  std::string r = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      r += '\\';
+    r += c;
+  }
+  return r + "\"";
+}
+
+void bench_output::meta (const char * name, const std::string & value) {
+  metas.push_back(std::make_pair(std::string(name), value));
+}
+
+void bench_output::start (void) {
+  started = true;
+  if (json) {
+    fprintf(f, "{\n");
+    for (auto & m : metas)
+      fprintf(f, "  %s: %s,\n", json_string(m.first).c_str(), json_string(m.second).c_str());
+    fprintf(f, "  \"results\": [");
+  } else {
+    for (auto & m : metas)
+      fprintf(f, "# %s: %s\n", m.first.c_str(), m.second.c_str());
+  }
+}
+
+void bench_output::row (const std::vector<bench_field> & r) {
+  if (!started)
+    start();
+  if (json) {
+    fprintf(f, "%s\n    {", rows? ",": "");
+    for (size_t i=0; i<r.size(); i++)
+      fprintf(f, "%s%s: %s", i? ", ": "", json_string(r[i].name).c_str(),
+	      r[i].number? r[i].value.c_str(): json_string(r[i].value).c_str());
+    fprintf(f, "}");
+  } else {
+    if (!rows)
+      for (size_t i=0; i<r.size(); i++)
+	fprintf(f, "%s%s", i? ",": "", r[i].name.c_str());
+    if (!rows)
+      fprintf(f, "\n");
+    for (size_t i=0; i<r.size(); i++)
+      fprintf(f, "%s%s", i? ",": "", r[i].value.c_str());
+    fprintf(f, "\n");
+  }
+  rows++;
+  fflush(f);
+}
+
+void bench_output::finish (void) {
+  if (!started)
+    start();
+  if (json && started) {
+    fprintf(f, "\n  ]\n}\n");
+    json = false; // Only once
+  }
+  fflush(f);
+}
+
+/*** Messages and sizes ***/
+
+const uint8_t bench_key[16] = {  0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+				 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 };
+
+uint8_t * bench_message (size_t len) {
+  void * p = NULL;
+  if (posix_memalign(&p, 64, len? len: 1))
+    return NULL;
+  uint8_t * M = (uint8_t *)p;
+  for (size_t i=0; i<len; i++)
+    M[i] = i;
+  return M;
+}
+
+void bench_init_key (struct MAC611_context * ctx, const uint8_t k[16]) {
+#ifdef MAC611_TABLES_BYTES
+  // Allocation of the tables: no mode can run without them
+  if (MAC611_init(ctx, k)) {
+    fprintf(stderr, "bench: MAC611_init failed (tables allocation)\n");
+    abort();
+  }
+#else
+  MAC611_init(ctx, k);
+#endif
+}
+
+void bench_init (struct MAC611_context * ctx) {
+  bench_init_key(ctx, bench_key);
+}
+
+void bench_release (struct MAC611_context * ctx) {
+#ifdef MAC611_TABLES_BYTES
+  MAC611_free(ctx);
+#else
+  (void)ctx;
+#endif
+}
+
+size_t bench_reps (const bench_options & o, size_t len) {
+  if (o.reps)
+    return o.reps;
+  return std::min<size_t>(100000, std::max<size_t>(5, (256u<<20)/(len+1)));
+}
+
+std::vector<size_t> bench_sizes (const bench_options & o, size_t default_max) {
+  size_t max_len = o.max_len? o.max_len: default_max;
+  std::vector<size_t> s = { 0, 7, 7*LAMBDA, 7*LAMBDA+1 };
+  for (size_t l=1; l && l<=max_len; l*=2)
+    s.push_back(l);
+  std::sort(s.begin(), s.end());
+  s.erase(std::unique(s.begin(), s.end()), s.end());
+  s.erase(std::remove_if(s.begin(), s.end(), [&](size_t l) { return l < o.min_len || l > max_len; }), s.end());
+  return s;
+}
+
+/*** Mode: size sweep ***/
+
+int bench_sweep (const bench_options & o, bench_output & out) {
+  std::vector<size_t> sizes = bench_sizes(o, 1<<30);
+  if (sizes.empty())
+    return 0;
+
+  size_t max_len = sizes.back();
+  uint8_t * M = NULL;
+  while (!(M = bench_message(max_len)) && max_len > 1) {
+    max_len /= 2;
+    fprintf(stderr, "bench: allocation failed, largest size reduced to %zu\n", max_len);
+  }
+  if (!M)
+    return 1;
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t N[8] = {0};
+  uint64_t overhead = bench_overhead();
+  double rate = bench_tick_rate();
+
+  for (size_t len : sizes) {
+    if (len > max_len)
+      break;
+    for (int cold=0; cold<=(int)o.cold; cold++) {
+      size_t reps = bench_reps(o, len);
+      std::vector<uint64_t> t(reps);
+      uint8_t tag[8];
+
+      for (size_t i=0; i<o.warmup; i++)
+	MAC611_tag(&ctx, M, len, N, tag);
+      for (size_t r=0; r<reps; r++) {
+	if (cold) {
+	  bench_flush(M, len);
+	  bench_flush(&ctx, sizeof(ctx));
+	}
+	uint64_t t0 = bench_start();
+	MAC611_tag(&ctx, M, len, N, tag);
+	uint64_t t1 = bench_stop();
+	t[r] = t1-t0 > overhead? t1-t0-overhead: 0;
+      }
+      bench_keep(tag);
+
+      bench_stats s = bench_compute(t);
+      double scale = len? (double)len: 1.0;
+      std::vector<bench_field> row = {
+	F("cache", cold? "cold": "warm"), F("len", (uint64_t)len), F("reps", (uint64_t)reps),
+	F("min", s.min), F("median", s.median), F("mean", s.mean),
+	F("stddev", s.stddev), F("max", s.max),
+	F("min_per_byte", s.min/scale), F("median_per_byte", s.median/scale),
+	F("gbps", s.median? len*rate/s.median/1e9: 0.0) };
+
+      // Counted separately, so that the ioctls do not disturb the timings
+      if (o.counters && o.counters->available()) {
+	for (size_t r=0; r<reps; r++) {
+	  if (cold) {
+	    bench_flush(M, len);
+	    bench_flush(&ctx, sizeof(ctx));
+	  }
+	  o.counters->start();
+	  MAC611_tag(&ctx, M, len, N, tag);
+	  o.counters->stop(r > 0);
+	}
+	o.counters->append(row, scale*reps, len? "per_byte": "per_call");
+      }
+      out.row(row);
+    }
+  }
+
+  bench_release(&ctx);
+  free(M);
+  return 0;
+}
+
+/*** Driver ***/
+
+struct bench_mode {
+  const char * name;
+  int (*run) (const bench_options &, bench_output &);
+  const char * help;
+};
+
+static const bench_mode MODES[] = {
+  { "sweep", bench_sweep, "cycles per byte of MAC611_tag over a size sweep" },
+  { "latency", bench_latency, "per-call latency percentiles (log-bucketed histogram)" },
+  { "threads", bench_threads, "multi-thread scaling with shared and private contexts" },
+  { "replay", bench_replay, "replay a trace of message sizes (len [gap_ns [key_id]] per line)" },
+  { "baseline", bench_baseline, "cycles/byte and latency metrics, to be saved as a baseline" },
+  { "compare", bench_compare, "compare with a baseline file, exit status 1 on regression" },
+#ifdef MAC611_PROFILE
+  { "profile", bench_profile, "share of load, mul, rekey and final per size (MAC611_PROFILE build)" },
+#endif
+#ifndef MAC611_TABLES_BYTES
+  { "kernels", bench_kernels, "latency and throughput of mul611, REDUCE_611, Noekeon, rekey, final" },
+#else
+  { "kernels", bench_kernels, "latency and throughput of mul611_mt, Noekeon and the table build" },
+#endif
+#ifndef MAC611_TABLES_BYTES // ref only: streaming API and tools
+  { "stream", bench_stream, "tag files: read then tag, mmap, and overlapped reads (thread, io_uring)" },
+  { "udp", bench_udp, "load generator for mac611d (host:port [sign|verify [keyfile]])" },
+  { "ipc", bench_ipc, "shared-memory tagging service: round trip and msgs/s per wakeup mode" },
+  { "log", bench_log, "authenticated record log: group-committed appends, parallel verify, reads ([dir])" },
+  { "chunk", bench_chunk, "chunked objects: parallel manifest build, full and range verification ([MiB])" },
+  { "verify", bench_verify, "batch verification: msgs/s of tagbatch_verify per thread count and length" },
+  { "nonce", bench_nonce, "nonce allocation: mutex, atomic counter and noncepool per thread count ([check])" },
+#endif
+};
+
+static void usage (const char * prog) {
+  fprintf(stderr,
+	  "Usage: %s [mode] [options] [args]\n"
+	  "Modes:\n", prog);
+  for (const bench_mode & m : MODES)
+    fprintf(stderr, "  %-10s %s\n", m.name, m.help);
+  fprintf(stderr,
+	  "Options:\n"
+	  "  -c cpu   pin to cpu (default 0, -1 to disable)\n"
+	  "  -n reps  repetitions per measurement (default: automatic)\n"
+	  "  -w n     warmup calls (default 3)\n"
+	  "  -s len   smallest message (default 0)\n"
+	  "  -m len   largest message (default 1 GiB for sweep, 64 KiB for latency)\n"
+	  "  -C       also run with cold caches\n"
+	  "  -j       JSON output (default CSV)\n"
+	  "  -e       hardware counters (perf_event_open): IPC and events per byte/op\n"
+	  "  -E n=cfg add a raw perf event (implies -e), e.g. -E p0=0x01a1\n");
+}
+
+int main (int argc, char * argv[])
+{
+  const bench_mode * mode = &MODES[0];
+  if (argc > 1 && argv[1][0] != '-') {
+    mode = NULL;
+    for (const bench_mode & m : MODES)
+      if (strcmp(argv[1], m.name) == 0)
+	mode = &m;
+    if (!mode) {
+      usage(argv[0]);
+      return 2;
+    }
+    argc--;
+    argv++;
+  }
+
+  bench_options o;
+  o.cpu = 0;
+  o.reps = 0;
+  o.warmup = 3;
+  o.min_len = 0;
+  o.max_len = 0;
+  o.cold = false;
+  o.json = false;
+  o.counters = NULL;
+  bool counters = false;
+
+  int c;
+  while ((c = getopt(argc, argv, "c:n:w:s:m:CjeE:h")) != -1) {
+    switch (c) {
+    case 'c': o.cpu = atoi(optarg); break;
+    case 'n': o.reps = strtoull(optarg, NULL, 0); break;
+    case 'w': o.warmup = strtoull(optarg, NULL, 0); break;
+    case 's': o.min_len = strtoull(optarg, NULL, 0); break;
+    case 'm': o.max_len = strtoull(optarg, NULL, 0); break;
+    case 'C': o.cold = true; break;
+    case 'j': o.json = true; break;
+    case 'e': counters = true; break;
+    case 'E': counters = true; o.raw_events.push_back(optarg); break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  for (int i=optind; i<argc; i++)
+    o.args.push_back(argv[i]);
+
+  if (o.cpu >= 0 && bench_pin(o.cpu))
+    fprintf(stderr, "bench: cannot pin to cpu %d\n", o.cpu);
+
+  bench_counters perf;
+  if (counters) {
+    perf.open(o.raw_events);
+    o.counters = &perf;
+  }
+
+  bench_output out(stdout, o.json);
+  out.meta("mode", mode->name);
+  out.meta("implem", MUL_IMPLEM);
+  out.meta("cpu_model", bench_cpu_model());
+  out.meta("cpu", std::to_string(o.cpu));
+  out.meta("unit", TICK_UNIT);
+  out.meta("timer_overhead", std::to_string(bench_overhead()));
+  out.meta("tick_rate", std::to_string((uint64_t)bench_tick_rate()));
+  if (counters)
+    out.meta("counters", perf.status());
+
+  int ret = mode->run(o, out);
+  out.finish();
+
+#ifdef MAC611_STATS
+  struct MAC611_stats st;
+  MAC611_get_stats(&st);
+  fprintf(stderr, "# stats: inits %llu, finals %llu, bytes %llu, blocks %llu, rekeys %llu, noekeon %llu\n",
+	  (unsigned long long)st.inits, (unsigned long long)st.finals, (unsigned long long)st.bytes,
+	  (unsigned long long)st.blocks, (unsigned long long)st.rekeys, (unsigned long long)st.noekeon);
+  fprintf(stderr, "# stats: sizes");
+  for (int i=0; i<MAC611_STATS_SIZES; i++)
+    if (st.sizes[i])
+      fprintf(stderr, " [%llu..%llu]:%llu", i? 1ULL<<(i-1): 0ULL, i? (2ULL<<(i-1))-1: 0ULL,
+	      (unsigned long long)st.sizes[i]);
+  fprintf(stderr, "\n");
+#endif
+  return ret;
+}
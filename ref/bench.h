@@ -0,0 +1,257 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * (c) 2018-2019 XXXX
+ *
+ * Shared by the modes of bench.cpp:
+ * - serialized timer (lfence/rdtsc ... rdtscp/lfence on x86,
+ *   CLOCK_MONOTONIC nanoseconds otherwise)
+ * - CPU pinning
+ * - statistics over repeated measurements
+ * - CSV / JSON output
+ ************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "MAC611.h"
+
+/*** Timer ***/
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+// Earlier instructions complete before the counter is read,
+// later ones do not start before
+static inline uint64_t bench_start (void) {
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+}
+
+// rdtscp waits for earlier instructions
+static inline uint64_t bench_stop (void) {
+  unsigned int aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+}
+#define TICK_UNIT "cycles"
+
+#else
+#include <time.h>
+static inline uint64_t bench_start (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#define bench_stop bench_start
+#define TICK_UNIT "ns"
+#endif
+
+// Minimum cost of an empty bench_start/bench_stop pair
+uint64_t bench_overhead (void);
+
+// Ticks per second (calibrated against CLOCK_MONOTONIC)
+double bench_tick_rate (void);
+
+// Prevent the compiler from removing a computation
+template <class T>
+static inline void bench_keep (T const & x) {
+  __asm__ __volatile__("" :: "g"(&x) : "memory");
+}
+
+/*** Environment ***/
+
+// Pin the calling thread to cpu; returns 0 on success
+int bench_pin (int cpu);
+
+// CPU model name (from /proc/cpuinfo when available)
+std::string bench_cpu_model (void);
+
+// Evict buf[0..len) from the caches
+void bench_flush (const void * buf, size_t len);
+
+/*** Statistics ***/
+
+struct bench_stats {
+  size_t n;
+  double min, median, mean, stddev, max;
+};
+
+// Sorts t
+bench_stats bench_compute (std::vector<uint64_t> & t);
+
+/*** Log-bucketed latency histogram (HDR style) ***/
+
+// Values below 2^HIST_SUB are exact; above, each power of two is
+// split in 2^(HIST_SUB-1) buckets (relative error < 2^-(HIST_SUB-1))
+#define HIST_SUB     5
+#define HIST_BUCKETS ((64-HIST_SUB+2) << (HIST_SUB-1))
+
+class bench_histogram {
+public:
+  bench_histogram () { reset(); }
+  void reset (void);
+
+  // A few instructions: no allocation, no division
+  inline void record (uint64_t v) {
+    if (v >= max_value)
+      max_value = v;
+    count++;
+    buckets[index(v)]++;
+  }
+
+  void merge (const bench_histogram & h);
+  uint64_t total (void) const { return count; }
+  uint64_t max (void) const { return max_value; }
+  // Highest value of the bucket holding the q-quantile (0 <= q <= 1)
+  uint64_t quantile (double q) const;
+  // Number of values above v (at bucket resolution)
+  uint64_t above (uint64_t v) const;
+
+  static inline unsigned index (uint64_t v) {
+    if (v < (1u << HIST_SUB))
+      return v;
+    unsigned e = 63-__builtin_clzll(v) - HIST_SUB + 1;
+    return (e << (HIST_SUB-1)) + (unsigned)(v >> e);
+  }
+  static uint64_t lowest (unsigned i);
+  static uint64_t highest (unsigned i);
+
+private:
+  uint64_t count, max_value;
+  uint64_t buckets[HIST_BUCKETS];
+};
+
+/*** Output ***/
+
+struct bench_field {
+  std::string name, value;
+  bool number;
+};
+
+bench_field F (const char * name, const char * value);
+bench_field F (const char * name, const std::string & value);
+bench_field F (const char * name, uint64_t value);
+bench_field F (const char * name, double value);
+
+// CSV: '#' comment lines for meta, a header line, then rows.
+// JSON: { meta..., "results": [ {row}, ... ] }
+class bench_output {
+public:
+  bench_output (FILE * f, bool json) : f(f), json(json), rows(0), started(false) {}
+  ~bench_output () { finish(); }
+  void meta (const char * name, const std::string & value);
+  void row (const std::vector<bench_field> & r);
+  void finish (void);
+private:
+  FILE * f;
+  bool json;
+  size_t rows;
+  bool started;
+  std::vector<std::pair<std::string, std::string> > metas;
+  void start (void);
+};
+
+/*** Hardware performance counters (Linux perf_event_open) ***/
+
+// Events that cannot be opened (not permitted, not supported)
+// are left out; all of them when perf_event_open is unavailable
+class bench_counters {
+public:
+  bench_counters () {}
+  ~bench_counters ();
+  // Generic events, then raw events given as name=config
+  void open (const std::vector<std::string> & raw);
+  bool available (void) const { return !events.empty(); }
+  const std::string & status (void) const { return why; }
+
+  // Counting is enabled between start and stop; with add, the
+  // counts are added to those of the previous start/stop
+  void start (void);
+  void stop (bool add = false);
+  // Append ipc and the events per unit (e.g. per byte) to a row
+  void append (std::vector<bench_field> & row, double units, const char * per) const;
+
+private:
+  struct event {
+    std::string name;
+    int fd;
+    double value;
+  };
+  std::vector<event> events;
+  std::string why;
+};
+
+/*** Options shared by all modes ***/
+
+struct bench_options {
+  int cpu;              // -c: CPU to pin to, -1 for none
+  size_t reps;          // -n: repetitions (0: automatic)
+  size_t warmup;        // -w: warmup calls
+  size_t min_len;       // -s: smallest message
+  size_t max_len;       // -m: largest message (0: mode default)
+  bool cold;            // -C: also run with cold caches
+  bool json;            // -j: JSON output
+  std::vector<std::string> raw_events; // -E: raw perf events
+  bench_counters * counters; // -e: counters, NULL when disabled
+  std::vector<std::string> args; // Remaining arguments
+};
+
+// Repetitions for a message of len bytes: ~256 MB per size,
+// between 5 and 100000 calls
+size_t bench_reps (const bench_options & o, size_t len);
+
+// Message sizes: 0, powers of two and 7*LAMBDA multiples,
+// up to o.max_len or default_max
+std::vector<size_t> bench_sizes (const bench_options & o, size_t default_max);
+
+// Number of rekeys in a tag of len bytes (the partial block counts)
+static inline size_t bench_rekeys (size_t len) {
+  return (len+6)/7/LAMBDA;
+}
+
+// Key, nonce and message used by all modes
+extern const uint8_t bench_key[16];
+uint8_t * bench_message (size_t len);
+void bench_init (struct MAC611_context * ctx);
+// Same with key k (aborts if MAC611_init fails, as bench_init)
+void bench_init_key (struct MAC611_context * ctx, const uint8_t k[16]);
+void bench_release (struct MAC611_context * ctx);
+
+/*** Modes ***/
+
+// Median ticks per op of each kernel of the kernels mode, named
+// "kernel/backend/latency" or ".../throughput"
+struct bench_kernel_result {
+  std::string metric;
+  double per_op;
+};
+std::vector<bench_kernel_result> bench_kernel_results (const bench_options & o);
+
+int bench_sweep (const bench_options & o, bench_output & out);
+int bench_kernels (const bench_options & o, bench_output & out);
+int bench_latency (const bench_options & o, bench_output & out);
+int bench_threads (const bench_options & o, bench_output & out);
+int bench_replay (const bench_options & o, bench_output & out);
+int bench_baseline (const bench_options & o, bench_output & out);
+int bench_compare (const bench_options & o, bench_output & out);
+int bench_stream (const bench_options & o, bench_output & out);
+int bench_udp (const bench_options & o, bench_output & out);
+int bench_ipc (const bench_options & o, bench_output & out);
+int bench_log (const bench_options & o, bench_output & out);
+int bench_chunk (const bench_options & o, bench_output & out);
+int bench_verify (const bench_options & o, bench_output & out);
+int bench_nonce (const bench_options & o, bench_output & out);
+#ifdef MAC611_PROFILE
+int bench_profile (const bench_options & o, bench_output & out);
+#endif
+
+#endif // BENCH_H
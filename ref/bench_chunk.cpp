@@ -0,0 +1,143 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "chunk": chunked objects (tagchunk.h)
+ * (c) 2018-2019 XXXX
+ *
+ * Argument: [MiB], the object size (default 64). First the tag of
+ * the whole object with MAC611_tag, the cost of checking any range
+ * without chunks. Then for chunks of 7 KiB, 63 KiB and 1008 KiB:
+ * - build: manifest of the object with 1 to all online CPUs (GB/s)
+ * - full: verification of the whole object (GB/s)
+ * - range: verification of random ranges of 4 KiB, 64 KiB and
+ *   1 MiB (ns per range, bytes hashed per range)
+ * - tamper: one byte of the object flipped (the ranges over it must
+ *   fail with EBADMSG, the others verify), and one byte of the
+ *   manifest (tagchunk_load must fail)
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "tagchunk.h"
+#include "toolutil.h"
+
+static const uint32_t CHUNKS[] = { 7*1024, TAGCHUNK_DEFAULT_SIZE, 7*1024*144 };
+static const uint64_t RANGES[] = { 4096, 65536, 1<<20 };
+
+int bench_chunk (const bench_options & o, bench_output & out) {
+  uint64_t size = (o.args.empty()? 64: strtoull(o.args[0].c_str(), NULL, 0)) << 20;
+  uint8_t * M = bench_message(size);
+  if (!M) {
+    fprintf(stderr, "bench: cannot allocate %llu bytes\n", (unsigned long long)size);
+    return 1;
+  }
+  out.meta("object_bytes", std::to_string(size));
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  uint8_t N[8] = {0}, tag[8];
+  int ret = 0;
+
+  uint64_t t0 = now_ns();
+  MAC611_tag(&ctx, M, size, N, tag);
+  double whole = (now_ns()-t0)*1e-9;
+  out.row({ F("phase", "whole"), F("chunk", (uint64_t)0), F("threads", (uint64_t)1),
+	    F("range", size), F("gbps", size/whole/1e9), F("ns", whole*1e9), F("hashed", size) });
+
+  for (uint32_t chunk : CHUNKS) {
+    struct tagchunk_manifest m;
+    memset(&m, 0, sizeof(m));
+    for (int threads = 1; threads <= ncpu; threads = threads < ncpu && 2*threads > ncpu? ncpu: 2*threads) {
+      tagchunk_free(&m);
+      t0 = now_ns();
+      if (tagchunk_build(&ctx, 1, M, size, chunk, threads, &m)) {
+	fprintf(stderr, "bench: chunk: tagchunk_build failed\n");
+	ret = 1;
+	goto done;
+      }
+      double seconds = (now_ns()-t0)*1e-9;
+      out.row({ F("phase", "build"), F("chunk", (uint64_t)chunk), F("threads", (uint64_t)threads),
+		F("range", size), F("gbps", size/seconds/1e9), F("ns", seconds*1e9), F("hashed", size) });
+    }
+
+    {
+      // The manifest goes through its serialized form, as when stored
+      struct tagchunk_manifest loaded;
+      if (tagchunk_load(&ctx, m.bytes, m.len, &loaded)) {
+	fprintf(stderr, "bench: chunk: manifest does not verify\n");
+	ret = 1;
+	tagchunk_free(&m);
+	goto done;
+      }
+      tagchunk_free(&m);
+      m = loaded;
+    }
+
+    t0 = now_ns();
+    if (tagchunk_verify_range(&ctx, &m, M, 0, size)) {
+      fprintf(stderr, "bench: chunk: object does not verify\n");
+      ret = 1;
+    }
+    double seconds = (now_ns()-t0)*1e-9;
+    out.row({ F("phase", "full"), F("chunk", (uint64_t)chunk), F("threads", (uint64_t)1),
+	      F("range", size), F("gbps", size/seconds/1e9), F("ns", seconds*1e9), F("hashed", size) });
+
+    for (uint64_t range : RANGES) {
+      if (range > size)
+	continue;
+      size_t reps = o.reps? o.reps: 2000;
+      uint64_t x = 0x9e3779b97f4a7c15ULL, hashed = 0;
+      t0 = now_ns();
+      for (size_t r=0; r<reps; r++) {
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	uint64_t offset = x % (size - range + 1), first, n;
+	tagchunk_span(&m, offset, range, &first, &n);
+	hashed += std::min(size, (first+n)*chunk) - first*chunk;
+	if (tagchunk_verify_range(&ctx, &m, M, offset, range)) {
+	  fprintf(stderr, "bench: chunk: range does not verify\n");
+	  ret = 1;
+	  break;
+	}
+      }
+      double ns = (now_ns()-t0)/(double)reps;
+      out.row({ F("phase", "range"), F("chunk", (uint64_t)chunk), F("threads", (uint64_t)1),
+		F("range", range), F("gbps", range/ns), F("ns", ns), F("hashed", hashed/reps) });
+    }
+
+    {
+      // A byte in the middle of the object: its chunk and no other
+      uint64_t at = size/2, c = at / chunk;
+      M[at] ^= 1;
+      int bad = tagchunk_verify_range(&ctx, &m, M, at, 1) != EBADMSG ||
+	tagchunk_verify_range(&ctx, &m, M, c*chunk, 1) != EBADMSG ||
+	(c > 0 && tagchunk_verify_range(&ctx, &m, M, c*chunk-1, 1)) ||
+	((c+1)*chunk < size && tagchunk_verify_range(&ctx, &m, M, (c+1)*chunk, 1));
+      M[at] ^= 1;
+      // And in the manifest: the tag of one chunk
+      struct tagchunk_manifest forged;
+      m.bytes[m.len/2] ^= 1;
+      int err = tagchunk_load(&ctx, m.bytes, m.len, &forged);
+      m.bytes[m.len/2] ^= 1;
+      if (!err)
+	tagchunk_free(&forged);
+      bad |= err != EBADMSG;
+      if (bad) {
+	fprintf(stderr, "bench: chunk: flipped byte not detected\n");
+	ret = 1;
+      }
+      out.row({ F("phase", "tamper"), F("chunk", (uint64_t)chunk), F("threads", (uint64_t)1),
+		F("range", (uint64_t)1), F("status", bad? "FAILED": "ok") });
+    }
+    tagchunk_free(&m);
+  }
+
+ done:
+  free(M);
+  bench_release(&ctx);
+  return ret;
+}
@@ -0,0 +1,214 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Modes "baseline" and "compare": performance regression check
+ * (c) 2018-2019 XXXX
+ *
+ *   bench baseline > base.csv
+ *   bench compare base.csv
+ * Both modes measure, for each message length, MAC611_tag in
+ * RUNS independent runs: cycles per byte (median of the run),
+ * and the p50 and p99 latency per call; and the ticks per op of
+ * each kernel of the kernels mode (len 0, named
+ * kernel/backend/kind), so that a regression of one building
+ * block is reported on its own. A metric is the mean and standard
+ * deviation over the runs.
+ * "baseline" prints the metrics (CSV, with the implem/cpu_model
+ * meta lines). "compare" measures again and prints one row per
+ * metric; a metric regresses when it is slower by more than
+ *   max(FLOOR, 3 * sqrt(sd_base^2 + sd_now^2) / mean_base)
+ * and the exit status is 1 if any metric regresses, or is missing
+ * from the new measurement (status "missing": a kernel renamed or
+ * no longer run must not pass as no regression). Baselines of
+ * another MUL_IMPLEM, CPU model or time unit, and files without
+ * any metric, are rejected (exit 2).
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "bench.h"
+
+#define RUNS  5
+#define FLOOR 0.03 // Smallest relative change reported as a regression
+
+static const size_t LENGTHS[] = { 0, 16, 64, 256, 1024, 4096, 7168, 7169, 65536, 1<<20 };
+
+struct metric {
+  std::string name;
+  size_t len;
+  double mean, stddev;
+};
+
+static void summarize (std::vector<metric> & m, const char * name, size_t len, const std::vector<double> & x) {
+  double mean = 0, sq = 0;
+  for (double v : x)
+    mean += v;
+  mean /= x.size();
+  for (double v : x)
+    sq += (v-mean)*(v-mean);
+  m.push_back(metric{ name, len, mean, x.size() > 1? sqrt(sq/(x.size()-1)): 0 });
+}
+
+static std::vector<metric> measure (const bench_options & o) {
+  std::vector<metric> m;
+  size_t max_len = o.max_len? o.max_len: 1<<20;
+  uint8_t * M = bench_message(max_len);
+  if (!M)
+    return m;
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t N[8] = {0};
+  uint8_t tag[8];
+  uint64_t overhead = bench_overhead();
+  static bench_histogram h;
+
+  for (size_t len : LENGTHS) {
+    if (len < o.min_len || len > max_len)
+      continue;
+    size_t reps = o.reps? o.reps: std::min<size_t>(20000, std::max<size_t>(5, (32u<<20)/(len+1)));
+    std::vector<double> per_byte, p50, p99;
+
+    for (int run=0; run<RUNS; run++) {
+      std::vector<uint64_t> t(reps);
+      for (size_t i=0; i<o.warmup; i++)
+	MAC611_tag(&ctx, M, len, N, tag);
+      h.reset();
+      for (size_t r=0; r<reps; r++) {
+	uint64_t t0 = bench_start();
+	MAC611_tag(&ctx, M, len, N, tag);
+	uint64_t t1 = bench_stop();
+	t[r] = t1-t0 > overhead? t1-t0-overhead: 0;
+	h.record(t[r]);
+      }
+      bench_stats s = bench_compute(t);
+      per_byte.push_back(s.median/(len? len: 1));
+      p50.push_back(h.quantile(0.5));
+      p99.push_back(h.quantile(0.99));
+    }
+    bench_keep(tag);
+
+    summarize(m, len? "per_byte": "per_call", len, per_byte);
+    summarize(m, "p50", len, p50);
+    summarize(m, "p99", len, p99);
+  }
+  bench_release(&ctx);
+  free(M);
+
+  // Kernels: RUNS runs of all of them
+  std::vector<std::vector<bench_kernel_result> > k;
+  for (int run=0; run<RUNS; run++)
+    k.push_back(bench_kernel_results(o));
+  for (size_t i=0; i<k[0].size(); i++) {
+    std::vector<double> per_op;
+    for (const std::vector<bench_kernel_result> & r : k)
+      per_op.push_back(r[i].per_op);
+    summarize(m, k[0][i].metric.c_str(), 0, per_op);
+  }
+  return m;
+}
+
+int bench_baseline (const bench_options & o, bench_output & out) {
+  std::vector<metric> m = measure(o);
+  if (m.empty())
+    return 1;
+  for (const metric & x : m)
+    out.row({ F("metric", x.name), F("len", (uint64_t)x.len), F("mean", x.mean),
+	      F("stddev", x.stddev), F("runs", (uint64_t)RUNS) });
+  return 0;
+}
+
+// Baseline written by bench_baseline (CSV)
+static bool read_baseline (const char * name, std::vector<metric> & m,
+			   std::string & implem, std::string & cpu, std::string & unit) {
+  FILE * f = fopen(name, "r");
+  if (!f) {
+    fprintf(stderr, "bench: cannot open baseline %s\n", name);
+    return false;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == '#') {
+      const char * v = strchr(line, ':');
+      if (!v)
+	continue;
+      std::string key(line+2, v-line-2);
+      v += 2;
+      if (key == "implem")
+	implem = v;
+      else if (key == "cpu_model")
+	cpu = v;
+      else if (key == "unit")
+	unit = v;
+      else if (key == "mode" && strcmp(v, "baseline")) {
+	fprintf(stderr, "bench: %s is not a baseline (mode %s)\n", name, v);
+	fclose(f);
+	return false;
+      }
+      continue;
+    }
+    char metric_name[256];
+    unsigned long long len;
+    double mean, stddev;
+    if (sscanf(line, "%255[^,],%llu,%lf,%lf", metric_name, &len, &mean, &stddev) == 4)
+      m.push_back(metric{ metric_name, (size_t)len, mean, stddev });
+  }
+  fclose(f);
+  // E.g. a JSON baseline, or a CSV without rows
+  if (m.empty()) {
+    fprintf(stderr, "bench: no metric in baseline %s (CSV from bench baseline expected)\n", name);
+    return false;
+  }
+  return true;
+}
+
+int bench_compare (const bench_options & o, bench_output & out) {
+  if (o.args.empty()) {
+    fprintf(stderr, "bench: compare needs a baseline file (from bench baseline)\n");
+    return 2;
+  }
+  std::vector<metric> base;
+  std::string implem, cpu, unit;
+  if (!read_baseline(o.args[0].c_str(), base, implem, cpu, unit))
+    return 2;
+  if (implem != MUL_IMPLEM || cpu != bench_cpu_model() || unit != TICK_UNIT) {
+    fprintf(stderr, "bench: baseline is for '%s' on '%s' (%s), this is '%s' on '%s' (%s)\n",
+	    implem.c_str(), cpu.c_str(), unit.c_str(), MUL_IMPLEM, bench_cpu_model().c_str(), TICK_UNIT);
+    return 2;
+  }
+
+  std::vector<metric> now = measure(o);
+  int regressions = 0, missing = 0;
+  for (const metric & b : base) {
+    auto n = std::find_if(now.begin(), now.end(), [&](const metric & x) {
+	return x.name == b.name && x.len == b.len; });
+    if (n == now.end()) {
+      missing++;
+      out.row({ F("metric", b.name), F("len", (uint64_t)b.len), F("base", b.mean), F("now", 0.0),
+		F("delta_pct", 0.0), F("threshold_pct", 0.0), F("status", "missing") });
+      continue;
+    }
+    if (b.mean <= 0)
+      continue;
+
+    double delta = (n->mean - b.mean) / b.mean;
+    double noise = 3*sqrt(b.stddev*b.stddev + n->stddev*n->stddev) / b.mean;
+    double threshold = std::max(FLOOR, noise);
+    const char * status = "ok";
+    if (delta > threshold) {
+      status = "regression";
+      regressions++;
+    } else if (delta < -threshold) {
+      status = "improvement";
+    }
+    out.row({ F("metric", b.name), F("len", (uint64_t)b.len), F("base", b.mean), F("now", n->mean),
+	      F("delta_pct", 100*delta), F("threshold_pct", 100*threshold), F("status", status) });
+  }
+  if (regressions)
+    fprintf(stderr, "bench: %d regression(s)\n", regressions);
+  if (missing)
+    fprintf(stderr, "bench: %d baseline metric(s) missing\n", missing);
+  return regressions || missing? 1: 0;
+}
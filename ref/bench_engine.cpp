@@ -0,0 +1,151 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Benchmark matrix of the policy-based engine (MAC611_engine.hpp)
+ * (c) 2018-2019 XXXX
+ *
+ * Every combination of loader, multiplication, reduction, unroll
+ * and lanes is instantiated at compile time, checked against
+ * MAC611_tag, and timed. Build with
+ *   make bench_engine
+ * Usage: bench_engine [-H] [-f filter] [len...]
+ *   -H         print the CSV header
+ *   -f filter  only run combinations whose name contains filter
+ *              (name is loader/mul/reduction/uUnroll/lLanes)
+ * Output is CSV, one line per combination and message length:
+ *   name,loader,mul,reduction,unroll,lanes,len,ok,min,median,unit
+ * min/median are per byte (per call for empty messages), timed
+ * with bench_start/bench_stop less the timer overhead (bench.h).
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "MAC611_engine.hpp"
+#include "bench.h"
+
+/*** Matrix ***/
+
+typedef void (*tag_fn)(const struct MAC611_context*, const uint8_t*, size_t, const uint8_t[8], uint8_t[8]);
+
+struct entry {
+  std::string name;
+  const char *loader, *mul, *reduction;
+  unsigned unroll, lanes;
+  tag_fn tag;
+};
+
+template <class... T> struct types {};
+template <unsigned... V> struct values {};
+
+typedef types<mac611::load_byte, mac611::load_word, mac611::load_simd> LOADERS;
+#ifdef __SIZEOF_INT128__
+typedef types<mac611::mul_int128, mac611::mul_limb32, mac611::mul_base31, mac611::mul_table> MULS;
+#else
+typedef types<mac611::mul_limb32, mac611::mul_base31, mac611::mul_table> MULS;
+#endif
+typedef types<mac611::reduce_eager, mac611::reduce_lazy> REDUCTIONS;
+typedef values<1, 2, 4, 8> UNROLLS;
+typedef values<1, 2, 4, 8> LANES;
+
+template <class L, class M, class R, unsigned U, unsigned... N>
+static void add_lanes(std::vector<entry> & v, values<N...>) {
+  (v.push_back(entry{ std::string(L::name) + "/" + M::name + "/" + R::name +
+	             "/u" + std::to_string(U) + "/l" + std::to_string(N),
+	             L::name, M::name, R::name, U, N,
+		     mac611::engine<L, M, R, U, N>::tag }), ...);
+}
+
+template <class L, class M, class R, unsigned... U>
+static void add_unrolls(std::vector<entry> & v, values<U...>) {
+  (add_lanes<L, M, R, U>(v, LANES()), ...);
+}
+
+template <class L, class M, class... R>
+static void add_reductions(std::vector<entry> & v, types<R...>) {
+  (add_unrolls<L, M, R>(v, UNROLLS()), ...);
+}
+
+template <class L, class... M>
+static void add_muls(std::vector<entry> & v, types<M...>) {
+  (add_reductions<L, M>(v, REDUCTIONS()), ...);
+}
+
+template <class... L>
+static void add_loaders(std::vector<entry> & v, types<L...>) {
+  (add_muls<L>(v, MULS()), ...);
+}
+
+static const size_t LENGTHS[] = { 64, 1024, 7168, 16384, 1<<20 };
+
+int main(int argc, char *argv[])
+{
+  const char *filter = NULL;
+  std::vector<size_t> lengths;
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-H") == 0)
+      printf ("name,loader,mul,reduction,unroll,lanes,len,ok,min,median,unit\n");
+    else if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+      filter = argv[++i];
+    else
+      lengths.push_back(strtoull(argv[i], NULL, 0));
+  }
+  if (lengths.empty())
+    lengths.assign(LENGTHS, LENGTHS+sizeof(LENGTHS)/sizeof(LENGTHS[0]));
+
+  std::vector<entry> matrix;
+  add_loaders(matrix, LOADERS());
+
+  uint8_t k[16] = {  0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+  		     0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 };
+  uint8_t N[8] = {0};
+  struct MAC611_context ctx;
+  MAC611_init(&ctx, k);
+
+  size_t maxlen = *std::max_element(lengths.begin(), lengths.end());
+  uint8_t *M = (uint8_t*)malloc(maxlen+1);
+  if (!M) {
+    printf("Malloc failed (M)!\n");
+    exit(-1);
+  }
+  for (size_t i=0; i<maxlen; i++)
+    M[i] = i;
+
+  uint64_t overhead = bench_overhead();
+  int failed = 0;
+  for (const entry & e : matrix) {
+    if (filter && e.name.find(filter) == std::string::npos)
+      continue;
+
+    for (size_t len : lengths) {
+      uint8_t ref[8], tag[8];
+      MAC611_tag(&ctx, M, len, N, ref);
+      e.tag(&ctx, M, len, N, tag); // Also warms up caches
+      bool ok = memcmp(ref, tag, 8) == 0;
+      failed |= !ok;
+
+      // Aim for ~4 MB of input per length, with at least 15 runs
+      size_t reps = std::max<size_t>(15, (4u<<20)/(len+1));
+      std::vector<uint64_t> t(reps);
+      for (size_t r=0; r<reps; r++) {
+	uint64_t start = bench_start();
+	e.tag(&ctx, M, len, N, tag);
+	uint64_t stop = bench_stop();
+	t[r] = stop-start > overhead? stop-start-overhead: 0;
+      }
+      std::sort(t.begin(), t.end());
+
+      double scale = len? (double)len: 1.0;
+      printf ("%s,%s,%s,%s,%u,%u,%zu,%d,%.2f,%.2f,%s\n",
+	      e.name.c_str(), e.loader, e.mul, e.reduction, e.unroll, e.lanes,
+	      len, ok, t[0]/scale, t[reps/2]/scale, TICK_UNIT);
+    }
+  }
+
+  free(M);
+  return failed;
+}
@@ -0,0 +1,132 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "ipc": shared-memory tagging service (tagipc.h)
+ * (c) 2018-2019 XXXX
+ *
+ * The service runs in a child process (connected by a socketpair)
+ * and holds the context; the parent is the client. For each
+ * wakeup mode (eventfd, poll) and message length (arguments,
+ * default 0 64 1024 16384):
+ * - round trip: one synchronous tagipc_tag at a time (percentiles)
+ * - throughput: the ring is kept full for RUN_NS (msgs/s, GB/s)
+ * With -c cpu, the client is pinned to cpu and the service to the
+ * next CPU (if any): in poll mode both sides spin.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "tagipc.h"
+#include "toolutil.h"
+
+#define ENTRIES 256
+#define RUN_NS  300000000ULL
+
+int bench_ipc (const bench_options & o, bench_output & out) {
+  std::vector<size_t> lens;
+  for (const std::string & a : o.args)
+    lens.push_back(strtoull(a.c_str(), NULL, 0));
+  if (lens.empty())
+    lens = { 0, 64, 1024, 16384 };
+  size_t max_len = 1;
+  for (size_t l : lens)
+    max_len = std::max(max_len, l);
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t * M = bench_message(max_len);
+  if (!M)
+    return 1;
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  static bench_histogram h;
+  int ret = 0;
+
+  for (enum tagipc_mode mode : { TAGIPC_EVENTFD, TAGIPC_POLL }) {
+    const char * name = mode == TAGIPC_EVENTFD? "eventfd": "poll";
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+      perror("bench: socketpair");
+      ret = 1;
+      break;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(sv[0]);
+      if (o.cpu >= 0 && ncpu > 1)
+	bench_pin((o.cpu+1) % ncpu);
+      struct MAC611_context service;
+      MAC611_init(&service, bench_key);
+      _exit(tagipc_serve(&service, sv[1]));
+    }
+    close(sv[1]);
+    struct tagipc_client * c = pid > 0? tagipc_attach(sv[0], ENTRIES, ENTRIES*max_len, mode): NULL;
+    if (!c) {
+      perror("bench: tagipc");
+      close(sv[0]);
+      if (pid > 0)
+	waitpid(pid, NULL, 0);
+      ret = 1;
+      break;
+    }
+    unsigned entries = tagipc_entries(c);
+    uint8_t * P = tagipc_payload(c, NULL);
+    for (unsigned i=0; i<entries; i++)
+      memcpy(P + i*max_len, M, max_len);
+
+    for (size_t len : lens) {
+      uint8_t N[8] = {0};
+      uint8_t tag[8], ref[8];
+      MAC611_tag(&ctx, M, len, N, ref);
+      if (tagipc_tag(c, P, len, N, tag) || memcmp(tag, ref, 8)) {
+	fprintf(stderr, "bench: ipc %s: wrong tag for %zu bytes\n", name, len);
+	ret = 1;
+	continue;
+      }
+
+      // Round trip
+      size_t reps = o.reps? o.reps: 20000;
+      for (size_t i=0; i<o.warmup; i++)
+	tagipc_tag(c, P, len, N, tag);
+      h.reset();
+      for (size_t r=0; r<reps; r++) {
+	uint64_t t0 = now_ns();
+	tagipc_tag(c, P, len, N, tag);
+	h.record(now_ns()-t0);
+      }
+
+      // Throughput: the ring is refilled after each reap
+      struct tagipc_completion done[ENTRIES];
+      uint64_t msgs = 0, id = 0;
+      uint64_t start = now_ns(), end = start + RUN_NS, t;
+      while ((t = now_ns()) < end) {
+	while (tagipc_submit(c, P + (id % entries)*max_len, len, N, id) == 0)
+	  id++;
+	int n = tagipc_reap(c, done, ENTRIES, 1);
+	if (n < 0)
+	  break;
+	msgs += n;
+      }
+      for (int n; (n = tagipc_reap(c, done, ENTRIES, 1)) > 0; )
+	msgs += n;
+      double seconds = (now_ns()-start)*1e-9;
+
+      out.row({ F("wakeup", name), F("len", (uint64_t)len), F("reps", (uint64_t)reps),
+		F("p50_ns", h.quantile(0.5)), F("p99_ns", h.quantile(0.99)),
+		F("p999_ns", h.quantile(0.999)), F("max_ns", h.max()),
+		F("msgs_per_s", msgs/seconds), F("gbps", msgs*len/seconds/1e9) });
+    }
+
+    tagipc_close(c);
+    waitpid(pid, NULL, 0);
+  }
+
+  free(M);
+  bench_release(&ctx);
+  return ret;
+}
@@ -0,0 +1,211 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "kernels": microbenchmarks of the building blocks
+ * (c) 2018-2019 XXXX
+ *
+ * Each kernel is timed as
+ * - latency:    a dependent chain, each op uses the previous result
+ * - throughput: LANES independent chains, interleaved
+ * and reported in ticks per op. Kernels:
+ * - mul611 and REDUCE_611 of this build (MUL611_IMPLEM; build
+ *   bench_generic for the generic C version)
+ * - the multiplications of MAC611_engine.hpp, with reduction
+ * - Noekeon_encrypt
+ * - rekey: next hash key from the key index (Noekeon + reduce)
+ * - final: finalization of the hash state (reduce + Noekeon)
+ * A multiplication-bound tag runs at about mul611 latency per
+ * 7 bytes; rekey and final are paid per LAMBDA blocks and per call.
+ * With arm-tables (MAC611_TABLES_BYTES), the kernels are instead
+ * - mul611_mt: multiplication with the tables of the hash key
+ * - Noekeon_encrypt
+ * - table_build: the tables of one rekey (built per call for the
+ *   keys above TABLE_CACHE)
+ * bench_kernel_results runs the same kernels without output, for
+ * the metrics of baseline and compare.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#ifndef MAC611_TABLES_BYTES
+#include "mul611.h"
+#include "MAC611_engine.hpp"
+#endif
+
+#define LANES 8
+#define OPS   1024 // Ops per measurement and chain
+
+// Results of the kernels: rows (kernels mode) or medians per op
+struct kernel_sink {
+  bench_output * out;
+  std::vector<bench_kernel_result> * results;
+};
+
+// Time fn(x) as a dependent chain, and as LANES independent ones
+// (ops per measurement, a multiple of LANES; reps by default)
+template <class Fn>
+static void kernel (const bench_options & o, kernel_sink & out,
+		    const char * name, const char * backend, Fn fn,
+		    int ops = OPS, size_t default_reps = 2000) {
+  size_t reps = o.reps? o.reps: default_reps;
+  uint64_t overhead = bench_overhead();
+
+  for (int kind=0; kind<2; kind++) {
+    std::vector<uint64_t> t(reps);
+    uint64_t x[LANES];
+    for (int j=0; j<LANES; j++)
+      x[j] = 0x0123456789abcdefULL*(j+1) & MOD611;
+
+    for (size_t r=0; r<o.warmup+reps; r++) {
+      uint64_t t0 = bench_start();
+      if (kind == 0) {
+	for (int i=0; i<ops; i++)
+	  x[0] = fn(x[0], 0);
+      } else {
+	for (int i=0; i<ops/LANES; i++)
+	  for (int j=0; j<LANES; j++)
+	    x[j] = fn(x[j], j);
+      }
+      uint64_t t1 = bench_stop();
+      if (r >= o.warmup)
+	t[r-o.warmup] = t1-t0 > overhead? t1-t0-overhead: 0;
+    }
+    bench_keep(x);
+
+    bench_stats s = bench_compute(t);
+    if (out.results)
+      out.results->push_back(bench_kernel_result{ std::string(name) + "/" + backend + "/" + (kind? "throughput": "latency"),
+						  s.median/ops });
+    if (!out.out)
+      continue;
+    std::vector<bench_field> row = {
+      F("kernel", name), F("backend", backend), F("kind", kind? "throughput": "latency"),
+      F("ops", (uint64_t)ops), F("min", s.min/ops), F("median", s.median/ops),
+      F("stddev", s.stddev/ops) };
+
+    if (o.counters && o.counters->available()) {
+      o.counters->start();
+      for (size_t r=0; r<reps; r++) {
+	if (kind == 0) {
+	  for (int i=0; i<ops; i++)
+	    x[0] = fn(x[0], 0);
+	} else {
+	  for (int i=0; i<ops/LANES; i++)
+	    for (int j=0; j<LANES; j++)
+	      x[j] = fn(x[j], j);
+	}
+      }
+      o.counters->stop();
+      bench_keep(x);
+      o.counters->append(row, (double)reps*ops, "per_op");
+    }
+    out.out->row(row);
+  }
+}
+
+// Block cipher, one buffer per chain
+static void kernel_noekeon (const bench_options & o, kernel_sink & out, const struct MAC611_context & ctx) {
+  uint8_t blk[LANES][16] = {{0}};
+  kernel(o, out, "Noekeon_encrypt", "ref",
+	 [&](uint64_t x, int j) {
+	   uint8_t * b = blk[j];
+	   memcpy(b, &x, 8);
+	   Noekeon_encrypt(ctx.noekeon_key, b, b);
+	   uint64_t y;
+	   memcpy(&y, b+8, 8);
+	   return y;
+	 });
+}
+
+#ifndef MAC611_TABLES_BYTES
+// Engine multiplication policy, reduced after each product
+template <class Mul>
+static void kernel_mul (const bench_options & o, kernel_sink & out, uint64_t k) {
+  static typename Mul::key_t key; // Large for mul_table
+  Mul::prepare(key, k);
+  kernel(o, out, "mul611", (std::string("engine ")+Mul::name).c_str(),
+	 [&](uint64_t x, int) { return Mul::reduce(Mul::mul(x, key)); });
+}
+
+static void run_kernels (const bench_options & o, kernel_sink & out) {
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint64_t k = ctx.hash_key;
+
+  kernel(o, out, "mul611", MUL_IMPLEM,
+	 [&](uint64_t x, int) { return mul611(x, k); });
+  // Inputs above 2^63, so that each op reduces
+  kernel(o, out, "REDUCE_611", MUL_IMPLEM,
+	 [&](uint64_t x, int) { return REDUCE_611(x | (1ULL<<63)); });
+
+#ifdef __SIZEOF_INT128__
+  kernel_mul<mac611::mul_int128>(o, out, k);
+#endif
+  kernel_mul<mac611::mul_limb32>(o, out, k);
+  kernel_mul<mac611::mul_base31>(o, out, k);
+  kernel_mul<mac611::mul_table>(o, out, k);
+
+  kernel_noekeon(o, out, ctx);
+
+  // Rekey as in MAC611_tag: k_{i+1} = REDUCE(Noekeon(0^8 || i+1)), chained on the key
+  kernel(o, out, "rekey", MUL_IMPLEM,
+	 [&](uint64_t x, int) {
+	   unsigned char tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(x) };
+	   Noekeon_encrypt(ctx.noekeon_key, tmp, tmp);
+	   return REDUCE_611(read64(tmp));
+	 });
+
+  // Finalization as in MAC611_tag, chained on the tag
+  uint8_t N[8] = {0};
+  kernel(o, out, "final", MUL_IMPLEM,
+	 [&](uint64_t x, int) {
+	   uint64_t state = REDUCE_611(x) + (1ULL<<63);
+	   uint8_t S[16] = { write64(state) };
+	   memcpy(S+8, N, 8);
+	   Noekeon_encrypt(ctx.noekeon_key, S, S);
+	   return read64(S);
+	 });
+
+  bench_release(&ctx);
+}
+
+#else // arm-tables
+
+static void run_kernels (const bench_options & o, kernel_sink & out) {
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+
+  // Multiplication by the hash key: one table entry per window
+  kernel(o, out, "mul611_mt", MUL_IMPLEM,
+	 [&](uint64_t x, int) { return MAC611_mul_table(x, ctx.mul_table[0]); });
+
+  kernel_noekeon(o, out, ctx);
+
+  // Tables of a rekey (Noekeon, then TABLE_WINDOWS*TABLE_SIZE
+  // entries), chained on an entry; one scratch table per chain
+  std::vector<uint64_t> scratch((size_t)LANES*TABLE_WINDOWS*TABLE_SIZE);
+  uint64_t (*mt)[TABLE_WINDOWS][TABLE_SIZE] = (uint64_t (*)[TABLE_WINDOWS][TABLE_SIZE])scratch.data();
+  kernel(o, out, "table_build", MUL_IMPLEM,
+	 [&](uint64_t x, int j) {
+	   MAC611_build_table(ctx.noekeon_key, x, mt[j]);
+	   return mt[j][TABLE_WINDOWS-1][TABLE_SIZE-1];
+	 }, LANES, 100);
+
+  bench_release(&ctx);
+}
+
+#endif // MAC611_TABLES_BYTES
+
+int bench_kernels (const bench_options & o, bench_output & out) {
+  kernel_sink sink = { &out, NULL };
+  run_kernels(o, sink);
+  return 0;
+}
+
+std::vector<bench_kernel_result> bench_kernel_results (const bench_options & o) {
+  std::vector<bench_kernel_result> r;
+  kernel_sink sink = { NULL, &r };
+  run_kernels(o, sink);
+  return r;
+}
@@ -0,0 +1,82 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "latency": per-call latency distribution
+ * (c) 2018-2019 XXXX
+ *
+ * Every MAC611_tag call is timed and recorded in a log-bucketed
+ * histogram (bench_histogram), for up to a million calls per size.
+ * Sizes are those of the sweep (up to 64 KiB by default) plus both
+ * sides of each rekey boundary (7*LAMBDA*i-7 and 7*LAMBDA*i-6:
+ * the partial block counts towards the key lifetime).
+ * Columns:
+ * - rekeys:   Noekeon rekeys in one call
+ * - outliers: calls above 10x the median
+ * - flag:     "rekey" when p99 steps up by more than 5% from the
+ *             previous size and a rekey boundary lies in between,
+ *             "tail" when p99.9 is above 10x the median
+ ************************************************************/
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "bench.h"
+
+int bench_latency (const bench_options & o, bench_output & out) {
+  std::vector<size_t> sizes = bench_sizes(o, 64<<10);
+  if (sizes.empty())
+    return 0;
+  size_t max_len = sizes.back();
+  for (size_t i=1; 7*LAMBDA*i-6 <= max_len; i++) {
+    if (7*LAMBDA*i-7 >= o.min_len)
+      sizes.push_back(7*LAMBDA*i-7);
+    sizes.push_back(7*LAMBDA*i-6);
+  }
+  std::sort(sizes.begin(), sizes.end());
+  sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+  uint8_t * M = bench_message(max_len);
+  if (!M)
+    return 1;
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t N[8] = {0};
+  uint64_t overhead = bench_overhead();
+
+  static bench_histogram h;
+  uint64_t prev_p99 = 0;
+  size_t prev_rekeys = 0;
+
+  for (size_t len : sizes) {
+    size_t calls = o.reps? o.reps: std::min<size_t>(1000000, std::max<size_t>(1000, (1u<<30)/(len+1)));
+    uint8_t tag[8];
+
+    for (size_t i=0; i<o.warmup; i++)
+      MAC611_tag(&ctx, M, len, N, tag);
+    h.reset();
+    for (size_t r=0; r<calls; r++) {
+      uint64_t t0 = bench_start();
+      MAC611_tag(&ctx, M, len, N, tag);
+      uint64_t t1 = bench_stop();
+      h.record(t1-t0 > overhead? t1-t0-overhead: 0);
+    }
+    bench_keep(tag);
+
+    uint64_t p50 = h.quantile(0.5), p99 = h.quantile(0.99), p999 = h.quantile(0.999);
+    size_t rekeys = bench_rekeys(len);
+    const char * flag = "";
+    if (rekeys > prev_rekeys && prev_p99 && p99 > prev_p99*1.05)
+      flag = "rekey";
+    else if (p999 > 10*p50)
+      flag = "tail";
+
+    out.row({ F("len", (uint64_t)len), F("rekeys", (uint64_t)rekeys), F("calls", (uint64_t)calls),
+	      F("p50", p50), F("p90", h.quantile(0.9)), F("p99", p99), F("p999", p999),
+	      F("max", h.max()), F("outliers", h.above(10*p50)), F("flag", flag) });
+    prev_p99 = p99;
+    prev_rekeys = rekeys;
+  }
+
+  bench_release(&ctx);
+  free(M);
+  return 0;
+}
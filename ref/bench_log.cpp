@@ -0,0 +1,246 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "log": authenticated record log (taglog.h)
+ * (c) 2018-2019 XXXX
+ *
+ * Arguments: [dir], a directory for the log (default: a new
+ * directory under $TMPDIR or /tmp, removed at the end). For
+ * records of 64, 1024 and 16384 bytes (within -s/-m), without
+ * and with sync, 1, 4 and 16 threads append for RUN_NS:
+ * appends/s, MB/s and records per group (group commit). Then the
+ * whole log is verified with 1 to all online CPUs (records/s,
+ * GB/s) and random records are read back (ns per taglog_get).
+ * Last, the last record is damaged: one data byte flipped (verify
+ * and get must fail with EBADMSG on it), then cut in the middle
+ * (taglog_open must drop it, and the rest must verify).
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <thread>
+
+#include "bench.h"
+#include "taglog.h"
+#include "toolutil.h"
+
+#define RUN_NS 300000000ULL
+
+static const size_t LENS[] = { 64, 1024, 16384 };
+static const int APPENDERS[] = { 1, 4, 16 };
+
+// Removes the segments of a log (and the directory if rmdir)
+static void remove_log (const std::string & dir, bool rmdir_too) {
+  DIR * d = opendir(dir.c_str());
+  if (!d)
+    return;
+  while (struct dirent * de = readdir(d)) {
+    size_t n = strlen(de->d_name);
+    if (n > 4 && (!strcmp(de->d_name+n-4, ".log") || !strcmp(de->d_name+n-4, ".idx")))
+      unlink((dir + "/" + de->d_name).c_str());
+  }
+  closedir(d);
+  if (rmdir_too)
+    rmdir(dir.c_str());
+}
+
+// Path of the last segment of a log, without the extension
+static std::string last_segment (const std::string & dir) {
+  std::string last;
+  DIR * d = opendir(dir.c_str());
+  if (!d)
+    return last;
+  while (struct dirent * de = readdir(d)) {
+    size_t n = strlen(de->d_name);
+    if (n > 4 && !strcmp(de->d_name+n-4, ".log") && std::string(de->d_name, n-4) > last)
+      last = std::string(de->d_name, n-4);
+  }
+  closedir(d);
+  return last.empty()? last: dir + "/" + last;
+}
+
+// Flips a data byte of the last record (seq) of the log, then cuts
+// it in the middle. Returns 0 if both are caught.
+static int damage (const std::string & dir, const struct MAC611_context * ctx,
+		   const uint8_t * M, size_t len, uint64_t seq) {
+  std::string seg = last_segment(dir);
+  int fd = open((seg + ".log").c_str(), O_RDWR|O_CLOEXEC);
+  int ifd = open((seg + ".idx").c_str(), O_RDONLY|O_CLOEXEC);
+  struct stat ist;
+  uint8_t b[8];
+  if (fd < 0 || ifd < 0 || fstat(ifd, &ist) || ist.st_size < 8 || pread(ifd, b, 8, ist.st_size-8) != 8) {
+    fprintf(stderr, "bench: log: cannot read the last segment %s\n", seg.c_str());
+    if (fd >= 0)
+      close(fd);
+    if (ifd >= 0)
+      close(ifd);
+    return 1;
+  }
+  close(ifd);
+
+  // The data of the record follows its header: find it
+  off_t off = read64(b), data = -1;
+  std::vector<uint8_t> rec(len+64);
+  ssize_t n = pread(fd, rec.data(), rec.size(), off);
+  for (ssize_t i=0; i+(ssize_t)len <= n && i < 64 && data < 0; i++)
+    if (!memcmp(&rec[i], M, len))
+      data = off + i;
+  int failed = data < 0;
+
+  // Tamper: flip one byte
+  off_t at = data + len/2;
+  uint8_t x = M[len/2] ^ 0x20;
+  if (!failed && pwrite(fd, &x, 1, at) != 1)
+    failed = 1;
+  if (!failed) {
+    struct taglog_reader * r = taglog_reader_open(dir.c_str(), ctx);
+    uint64_t bad = 0;
+    const uint8_t * d;
+    size_t l;
+    failed = !r || taglog_verify(r, 0, &bad) != EBADMSG || bad != seq || taglog_get(r, seq, &d, &l) != EBADMSG;
+    if (r)
+      taglog_reader_close(r);
+    if (failed)
+      fprintf(stderr, "bench: log: flipped byte of record %llu not detected\n", (unsigned long long)seq);
+  }
+
+  // Truncate: the writer drops the partial record when it opens the log
+  if (!failed && (pwrite(fd, &M[len/2], 1, at) != 1 || ftruncate(fd, at)))
+    failed = 1;
+  close(fd);
+  if (!failed) {
+    struct taglog * log = taglog_open(dir.c_str(), ctx, NULL);
+    if (log)
+      taglog_close(log);
+    struct taglog_reader * r = log? taglog_reader_open(dir.c_str(), ctx): NULL;
+    uint64_t bad;
+    failed = !r || taglog_first(r) + taglog_count(r) != seq || taglog_verify(r, 0, &bad);
+    if (r)
+      taglog_reader_close(r);
+    if (failed)
+      fprintf(stderr, "bench: log: truncated record %llu not recovered\n", (unsigned long long)seq);
+  }
+  return failed;
+}
+
+int bench_log (const bench_options & o, bench_output & out) {
+  std::string dir;
+  bool own = o.args.empty();
+  if (own) {
+    const char * tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp? tmp: "/tmp") + "/mac611log.XXXXXX";
+    if (!mkdtemp(&templ[0])) {
+      perror("bench: mkdtemp");
+      return 1;
+    }
+    dir = templ;
+  } else {
+    dir = o.args[0];
+  }
+  out.meta("dir", dir);
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t * M = bench_message(LENS[2]);
+  if (!M)
+    return 1;
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int ret = 0;
+
+  for (size_t len : LENS) {
+    if (len < o.min_len || (o.max_len && len > o.max_len))
+      continue;
+    remove_log(dir, false);
+
+    // Append
+    for (int sync : { 0, 1 })
+      for (int threads : APPENDERS) {
+	struct taglog_options opts = { 0, sync };
+	struct taglog * log = taglog_open(dir.c_str(), &ctx, &opts);
+	if (!log) {
+	  perror("bench: taglog_open");
+	  ret = 1;
+	  goto done;
+	}
+	std::vector<std::thread> pool;
+	std::vector<uint64_t> appended(threads);
+	uint64_t start = now_ns(), end = start + RUN_NS;
+	for (int t=0; t<threads; t++)
+	  pool.emplace_back([&, t] {
+	    while (now_ns() < end && !taglog_append(log, M, len, NULL))
+	      appended[t]++;
+	  });
+	for (std::thread & t : pool)
+	  t.join();
+	double seconds = (now_ns()-start)*1e-9;
+	struct taglog_counts c;
+	taglog_counts(log, &c);
+	taglog_close(log);
+
+	uint64_t records = 0;
+	for (uint64_t a : appended)
+	  records += a;
+	out.row({ F("phase", "append"), F("len", (uint64_t)len), F("sync", (uint64_t)sync),
+		  F("threads", (uint64_t)threads), F("records", records),
+		  F("per_s", records/seconds), F("mbps", records*len/seconds/1e6),
+		  F("per_group", c.groups? (double)c.records/c.groups: 0.0) });
+      }
+
+    // Verify everything appended above
+    struct taglog_reader * r = taglog_reader_open(dir.c_str(), &ctx);
+    if (!r) {
+      perror("bench: taglog_reader_open");
+      ret = 1;
+      break;
+    }
+    uint64_t first = taglog_first(r), count = taglog_count(r);
+    for (int threads = 1; threads <= ncpu; threads = threads < ncpu && 2*threads > ncpu? ncpu: 2*threads) {
+      uint64_t bad, t0 = now_ns();
+      if (taglog_verify(r, threads, &bad)) {
+	fprintf(stderr, "bench: log: record %llu does not verify\n", (unsigned long long)bad);
+	ret = 1;
+	break;
+      }
+      double seconds = (now_ns()-t0)*1e-9;
+      out.row({ F("phase", "verify"), F("len", (uint64_t)len), F("threads", (uint64_t)threads),
+		F("records", count), F("per_s", count/seconds),
+		F("mbps", count*len/seconds/1e6) });
+    }
+
+    // Random reads
+    size_t reps = o.reps? o.reps: 100000;
+    uint64_t x = 0x9e3779b97f4a7c15ULL, t0 = now_ns();
+    for (size_t i=0; count && i<reps; i++) {
+      const uint8_t * data;
+      size_t l;
+      x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+      if (taglog_get(r, first + x % count, &data, &l) || l != len) {
+	fprintf(stderr, "bench: log: taglog_get failed\n");
+	ret = 1;
+	break;
+      }
+    }
+    out.row({ F("phase", "get"), F("len", (uint64_t)len), F("records", (uint64_t)reps),
+	      F("ns", count? (now_ns()-t0)/(double)reps: 0.0) });
+    taglog_reader_close(r);
+
+    // Damaged last record
+    if (count) {
+      int failed = damage(dir, &ctx, M, len, first+count-1);
+      ret |= failed;
+      out.row({ F("phase", "damage"), F("len", (uint64_t)len), F("records", count),
+		F("status", failed? "FAILED": "ok") });
+    }
+  }
+
+ done:
+  remove_log(dir, own);
+  free(M);
+  bench_release(&ctx);
+  return ret;
+}
@@ -0,0 +1,153 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "nonce": contention of nonce allocation (noncepool.h)
+ * (c) 2018-2019 XXXX
+ *
+ * 1 to max(online CPUs, 4) threads take nonces for RUN_NS with:
+ * - mutex: a counter behind a mutex (the usual sender)
+ * - atomic: one fetch-add on a shared counter per nonce
+ * - pool: noncepool_next, no persistence
+ * - persist: noncepool_next with a state file in $TMPDIR or /tmp
+ * Columns: nonces/s, ns per nonce per thread, and the
+ * reservations (blocks) of the pool. With the argument "check",
+ * every run also checks that no nonce is handed out twice, and
+ * persist runs that a second open of the state file is refused.
+ ************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include "bench.h"
+#include "noncepool.h"
+#include "toolutil.h"
+
+#define RUN_NS 300000000ULL
+
+enum kind { MUTEX, ATOMIC, POOL, PERSIST };
+static const char * const NAMES[] = { "mutex", "atomic", "pool", "persist" };
+
+// Each on its own cache line
+struct alignas(64) mutex_counter {
+  std::mutex lock;
+  uint64_t next = 0;
+};
+
+struct alignas(64) atomic_counter {
+  uint64_t next = 0;
+};
+
+struct alignas(64) thread_count {
+  uint64_t n = 0;
+};
+
+int bench_nonce (const bench_options & o, bench_output & out) {
+  bool check = !o.args.empty() && o.args[0] == "check";
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = std::max(ncpu, 4);
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+
+  const char * tmp = getenv("TMPDIR");
+  std::string path = std::string(tmp? tmp: "/tmp") + "/mac611nonce.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    perror("bench: mkstemp");
+    return 1;
+  }
+  close(fd);
+  out.meta("state_file", path);
+  int ret = 0;
+
+  for (int threads = 1; threads <= max_threads; threads = threads < max_threads && 2*threads > max_threads? max_threads: 2*threads)
+    for (kind k : { MUTEX, ATOMIC, POOL, PERSIST }) {
+      mutex_counter mc;
+      atomic_counter ac;
+      struct noncepool * pool = NULL;
+      if (k >= POOL && !(pool = noncepool_open(k == PERSIST? path.c_str(): NULL, &ctx, NULL))) {
+	perror("bench: noncepool_open");
+	ret = 1;
+	continue;
+      }
+      uint64_t start0 = k == PERSIST? noncepool_counter(pool): 0;
+      if (check && k == PERSIST) {
+	struct noncepool * other = noncepool_open(path.c_str(), &ctx, NULL);
+	if (other || errno != EWOULDBLOCK) {
+	  fprintf(stderr, "bench: nonce persist: state file opened twice\n");
+	  if (other)
+	    noncepool_close(other);
+	  ret = 1;
+	}
+      }
+
+      std::vector<thread_count> counts(threads);
+      std::vector<std::vector<uint64_t>> seen(check? threads: 0);
+      std::vector<std::thread> pool_threads;
+      int failed = 0;
+      uint64_t start = now_ns(), end = start + RUN_NS;
+      for (int t=0; t<threads; t++)
+	pool_threads.emplace_back([&, t] {
+	  uint64_t n = 0;
+	  while (now_ns() < end)
+	    for (int i=0; i<64; i++, n++) {
+	      uint64_t v;
+	      if (k == MUTEX) {
+		std::lock_guard<std::mutex> g(mc.lock);
+		v = mc.next++;
+	      } else if (k == ATOMIC) {
+		v = __atomic_fetch_add(&ac.next, 1, __ATOMIC_RELAXED);
+	      } else {
+		uint8_t nonce[8];
+		if (noncepool_next(pool, nonce)) {
+		  __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+		  return;
+		}
+		v = read64(nonce);
+	      }
+	      if (check)
+		seen[t].push_back(v);
+	    }
+	  counts[t].n = n;
+	});
+      for (std::thread & t : pool_threads)
+	t.join();
+      double seconds = (now_ns()-start)*1e-9;
+
+      uint64_t nonces = 0;
+      for (const thread_count & c : counts)
+	nonces += c.n;
+      uint64_t blocks = 0;
+      if (pool) {
+	blocks = (noncepool_counter(pool) - start0) / 4096;
+	noncepool_close(pool);
+      }
+      if (failed) {
+	fprintf(stderr, "bench: nonce %s: noncepool_next failed\n", NAMES[k]);
+	ret = 1;
+      }
+      if (check) {
+	std::vector<uint64_t> all;
+	for (const std::vector<uint64_t> & s : seen)
+	  all.insert(all.end(), s.begin(), s.end());
+	std::sort(all.begin(), all.end());
+	if (std::adjacent_find(all.begin(), all.end()) != all.end()) {
+	  fprintf(stderr, "bench: nonce %s: nonce handed out twice\n", NAMES[k]);
+	  ret = 1;
+	}
+      }
+
+      out.row({ F("kind", NAMES[k]), F("threads", (uint64_t)threads), F("nonces", nonces),
+		F("per_s", nonces/seconds), F("ns", seconds*1e9*threads/(nonces? nonces: 1)),
+		F("blocks", blocks) });
+    }
+
+  unlink(path.c_str());
+  unlink((path + ".lock").c_str());
+  bench_release(&ctx);
+  return ret;
+}
@@ -0,0 +1,143 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Hardware performance counters
+ * (c) 2018-2019 XXXX
+ *
+ * Counters are opened with the perf_event_open system call (no
+ * perf binary or library), for the calling thread, user space
+ * only, so that they also work with perf_event_paranoid=2.
+ * Each event is opened on its own; when the PMU is shared, the
+ * kernel multiplexes them and the values are scaled by
+ * time_enabled/time_running.
+ *
+ * Raw events (-E name=config) give access to model-specific
+ * events, e.g. the dispatch ports on Skylake:
+ *   -E p0=0x01a1 -E p1=0x02a1 -E p5=0x20a1 -E p6=0x40a1
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int perf_open (uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#define CACHE_READ_MISS(c) \
+  ((c) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+void bench_counters::open (const std::vector<std::string> & raw) {
+  struct { const char * name; uint32_t type; uint64_t config; } generic[] = {
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "l1d_misses",    PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "llc_misses",    PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+    // Software events (also in virtual machines without a PMU)
+    { "page_faults",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "ctx_switches",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+  };
+
+  std::vector<std::pair<std::string, std::pair<uint32_t, uint64_t> > > all;
+  for (auto & g : generic)
+    all.push_back(std::make_pair(g.name, std::make_pair(g.type, g.config)));
+  for (const std::string & r : raw) {
+    size_t eq = r.find('=');
+    if (eq == std::string::npos) {
+      fprintf(stderr, "bench: raw event '%s' is not name=config\n", r.c_str());
+      continue;
+    }
+    all.push_back(std::make_pair(r.substr(0, eq),
+				 std::make_pair((uint32_t)PERF_TYPE_RAW, strtoull(r.c_str()+eq+1, NULL, 0))));
+  }
+
+  std::string missing;
+  int err = 0;
+  for (auto & a : all) {
+    int fd = perf_open(a.second.first, a.second.second);
+    if (fd < 0) {
+      err = errno;
+      missing += (missing.empty()? "": " ") + a.first;
+      continue;
+    }
+    events.push_back(event{ a.first, fd, 0 });
+  }
+
+  if (events.empty())
+    why = std::string("unavailable (") + strerror(err) + ")";
+  else if (!missing.empty())
+    why = "missing " + missing + " (" + strerror(err) + ")";
+  else
+    why = "ok";
+}
+
+bench_counters::~bench_counters () {
+  for (event & e : events)
+    close(e.fd);
+}
+
+void bench_counters::start (void) {
+  for (event & e : events) {
+    ioctl(e.fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void bench_counters::stop (bool add) {
+  for (event & e : events)
+    ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+  for (event & e : events) {
+    uint64_t v[3]; // value, time_enabled, time_running
+    double x = -1;
+    if (read(e.fd, v, sizeof(v)) == sizeof(v) && v[2])
+      x = (double)v[0] * v[1] / v[2];
+    e.value = add && e.value >= 0 && x >= 0? e.value+x: x;
+  }
+}
+
+#else // __linux__
+
+void bench_counters::open (const std::vector<std::string> &) {
+  why = "unavailable (not Linux)";
+}
+
+bench_counters::~bench_counters () {}
+void bench_counters::start (void) {}
+void bench_counters::stop (bool) {}
+
+#endif // __linux__
+
+void bench_counters::append (std::vector<bench_field> & row, double units, const char * per) const {
+  double cycles = -1, instructions = -1;
+  for (const event & e : events) {
+    if (e.name == "cycles")
+      cycles = e.value;
+    if (e.name == "instructions")
+      instructions = e.value;
+  }
+  if (cycles >= 0 && instructions >= 0)
+    row.push_back(F("ipc", cycles > 0? instructions/cycles: 0.0));
+  // Rates of rare events are small: significant digits, not decimals
+  for (const event & e : events) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6g", e.value >= 0? e.value/units: -1.0);
+    row.push_back(bench_field{ e.name + "_" + per, buf, true });
+  }
+}
@@ -0,0 +1,80 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "profile": per-stage breakdown of MAC611_tag
+ * (c) 2018-2019 XXXX
+ *
+ * Needs a MAC611.c compiled with MAC611_PROFILE (make bench_profile).
+ * For each size, the per-thread stage counters are reset, MAC611_tag
+ * is called many times, and the ticks per call of each stage are
+ * reported with their share of the call:
+ * - load:  reading the 7-byte blocks
+ * - mul:   multiply chain (and length padding)
+ * - rekey: Noekeon for the next hash keys
+ * - final: finalization Noekeon
+ * - other: rest of the call (entry, timestamps not attributed)
+ * The cost of one timestamp read (bench_overhead) is removed from
+ * each timed interval. Loading and multiplying are separated by a
+ * buffer, so load+mul can be above the mul611 bound of the sweep.
+ ************************************************************/
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+#ifdef MAC611_PROFILE
+
+int bench_profile (const bench_options & o, bench_output & out) {
+  std::vector<size_t> sizes = bench_sizes(o, 1<<20);
+  if (sizes.empty())
+    return 0;
+  uint8_t * M = bench_message(sizes.back());
+  if (!M)
+    return 1;
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  uint8_t N[8] = {0};
+  uint8_t tag[8];
+  uint64_t overhead = bench_overhead();
+  const char * names[MAC611_STAGES] = { "load", "mul", "rekey", "final" };
+
+  for (size_t len : sizes) {
+    size_t reps = std::min<size_t>(bench_reps(o, len), 20000);
+    for (size_t i=0; i<o.warmup; i++)
+      MAC611_tag(&ctx, M, len, N, tag);
+
+    MAC611_reset_profile();
+    uint64_t total = 0;
+    for (size_t r=0; r<reps; r++) {
+      uint64_t t0 = bench_start();
+      MAC611_tag(&ctx, M, len, N, tag);
+      uint64_t t1 = bench_stop();
+      total += t1-t0 > overhead? t1-t0-overhead: 0;
+    }
+    bench_keep(tag);
+    struct MAC611_profile p;
+    MAC611_get_profile(&p);
+
+    double call = (double)total/reps, stage[MAC611_STAGES], sum = 0;
+    for (int s=0; s<MAC611_STAGES; s++) {
+      double t = p.ticks[s] > p.intervals[s]*overhead? p.ticks[s] - p.intervals[s]*overhead: 0;
+      stage[s] = t/reps;
+      sum += stage[s];
+    }
+    double other = call > sum? call-sum: 0;
+
+    std::vector<bench_field> row = { F("len", (uint64_t)len), F("calls", (uint64_t)reps), F("total", call) };
+    for (int s=0; s<MAC611_STAGES; s++)
+      row.push_back(F(names[s], stage[s]));
+    row.push_back(F("other", other));
+    for (int s=0; s<MAC611_STAGES; s++)
+      row.push_back(F((std::string(names[s])+"_pct").c_str(), call? 100*stage[s]/call: 0.0));
+    row.push_back(F("other_pct", call? 100*other/call: 0.0));
+    out.row(row);
+  }
+
+  bench_release(&ctx);
+  free(M);
+  return 0;
+}
+
+#endif // MAC611_PROFILE
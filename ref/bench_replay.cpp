@@ -0,0 +1,161 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "replay": replay of a message-size trace
+ * (c) 2018-2019 XXXX
+ *
+ * Usage: bench replay [options] trace [gaps]
+ * The trace is a text file ('-' for stdin), one message per line:
+ *   len [gap_ns [key_id]]
+ * separated by spaces or commas; '#' starts a comment.
+ * - gap_ns is the time since the previous message; with the
+ *   "gaps" argument, messages are issued at these times (open
+ *   loop) and the response time includes the queueing delay,
+ *   otherwise they are issued back to back.
+ * - key_id selects one context per distinct key (default 0).
+ * The trace is replayed -n times (default 1) after -w warmup
+ * calls from its start. One row per trace: total cost,
+ * throughput and service time percentiles (and response time
+ * percentiles with gaps).
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "bench.h"
+
+struct record {
+  size_t len;
+  uint64_t gap_ns;
+  uint64_t key;
+};
+
+static bool read_trace (const char * name, std::vector<record> & trace) {
+  FILE * f = strcmp(name, "-") == 0? stdin: fopen(name, "r");
+  if (!f) {
+    fprintf(stderr, "bench: cannot open trace %s\n", name);
+    return false;
+  }
+  char line[256];
+  size_t n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    n++;
+    char * c = strchr(line, '#');
+    if (c)
+      *c = 0;
+    for (c=line; *c; c++)
+      if (*c == ',')
+	*c = ' ';
+    unsigned long long v[3] = { 0, 0, 0 };
+    int k = sscanf(line, "%llu %llu %llu", &v[0], &v[1], &v[2]);
+    if (k <= 0) {
+      if (strspn(line, " \t\r\n") != strlen(line))
+	fprintf(stderr, "bench: %s:%zu: ignored\n", name, n);
+      continue;
+    }
+    trace.push_back(record{ (size_t)v[0], v[1], v[2] });
+  }
+  if (f != stdin)
+    fclose(f);
+  return true;
+}
+
+int bench_replay (const bench_options & o, bench_output & out) {
+  if (o.args.empty()) {
+    fprintf(stderr, "bench: replay needs a trace file\n");
+    return 2;
+  }
+  const char * name = o.args[0].c_str();
+  bool gaps = o.args.size() > 1 && o.args[1] == "gaps";
+
+  std::vector<record> trace;
+  if (!read_trace(name, trace))
+    return 1;
+  if (trace.empty()) {
+    fprintf(stderr, "bench: empty trace %s\n", name);
+    return 1;
+  }
+
+  // Contexts per key id
+  std::map<uint64_t, struct MAC611_context *> keys;
+  size_t max_len = 0;
+  for (record & r : trace) {
+    max_len = std::max(max_len, r.len);
+    if (!keys.count(r.key)) {
+      uint8_t k[16];
+      memcpy(k, bench_key, 16);
+      for (int i=0; i<8; i++)
+	k[i] ^= r.key >> (8*i);
+      struct MAC611_context * ctx = new MAC611_context;
+      bench_init_key(ctx, k);
+      keys[r.key] = ctx;
+    }
+  }
+  std::vector<const struct MAC611_context *> ctx(trace.size());
+  for (size_t i=0; i<trace.size(); i++)
+    ctx[i] = keys[trace[i].key];
+
+  uint8_t * M = bench_message(max_len);
+  if (!M)
+    return 1;
+  uint8_t N[8] = {0};
+  uint8_t tag[8];
+  uint64_t overhead = bench_overhead();
+  double rate = bench_tick_rate();
+
+  for (size_t i=0; i<o.warmup && i<trace.size(); i++)
+    MAC611_tag(ctx[i], M, trace[i].len, N, tag);
+
+  static bench_histogram service, response;
+  service.reset();
+  response.reset();
+  size_t passes = o.reps? o.reps: 1;
+  uint64_t bytes = 0, busy = 0;
+
+  uint64_t begin = bench_start();
+  for (size_t p=0; p<passes; p++) {
+    uint64_t arrival = bench_start();
+    for (size_t i=0; i<trace.size(); i++) {
+      const record & r = trace[i];
+      if (gaps) {
+	arrival += (uint64_t)(r.gap_ns*rate*1e-9);
+	while (bench_start() < arrival)
+	  ;
+      }
+      uint64_t t0 = bench_start();
+      MAC611_tag(ctx[i], M, r.len, N, tag);
+      uint64_t t1 = bench_stop();
+      uint64_t t = t1-t0 > overhead? t1-t0-overhead: 0;
+      service.record(t);
+      if (gaps)
+	response.record(t1 > arrival? t1-arrival: 0);
+      busy += t;
+      bytes += r.len;
+    }
+  }
+  uint64_t total = bench_stop()-begin;
+  bench_keep(tag);
+
+  double seconds = total/rate;
+  std::vector<bench_field> row = {
+    F("trace", name), F("records", (uint64_t)trace.size()), F("keys", (uint64_t)keys.size()),
+    F("passes", (uint64_t)passes), F("bytes", bytes), F("busy", busy), F("total", total),
+    F("busy_per_byte", bytes? (double)busy/bytes: 0.0), F("busy_per_msg", (double)busy/(passes*trace.size())),
+    F("gbps", bytes/seconds/1e9), F("msgs_per_s", passes*trace.size()/seconds),
+    F("p50", service.quantile(0.5)), F("p90", service.quantile(0.9)), F("p99", service.quantile(0.99)),
+    F("p999", service.quantile(0.999)), F("max", service.max()) };
+  if (gaps) {
+    row.push_back(F("resp_p50", response.quantile(0.5)));
+    row.push_back(F("resp_p99", response.quantile(0.99)));
+    row.push_back(F("resp_p999", response.quantile(0.999)));
+    row.push_back(F("resp_max", response.max()));
+  }
+  out.row(row);
+
+  for (auto & k : keys) {
+    bench_release(k.second);
+    delete k.second;
+  }
+  free(M);
+  return 0;
+}
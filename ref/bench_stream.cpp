@@ -0,0 +1,187 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "stream": tagging files, I/O and hashing overlapped or not
+ * (c) 2018-2019 XXXX
+ *
+ * Methods, for each file given as argument (default: a temporary
+ * file of -m bytes, 256 MiB by default):
+ * - read:   read the whole file into memory, then MAC611_tag
+ * - mmap:   MAC611_tag over a read-only mapping
+ * - thread: tagstream, reader thread with pread (per buffer size)
+ * - uring:  tagstream, io_uring reads (per buffer size)
+ * All methods must give the same tag. With -C, the page cache of
+ * the file is also dropped before each run (posix_fadvise), so
+ * that the reads come from the disk. The reader thread inherits
+ * the pinning: use -c -1 to let it run on another CPU.
+ * Columns: wall-clock ns (median and min) and GB/s.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "tagstream.h"
+#include "toolutil.h"
+
+static const size_t BUFFER_SIZES[] = { 64<<10, 256<<10, 1<<20, 4<<20 };
+#define BUFFERS 4
+
+static int read_tag (const struct MAC611_context * ctx, int fd, size_t len, uint8_t tag[8]) {
+  uint8_t * M = (uint8_t *)malloc(len? len: 1);
+  if (!M)
+    return ENOMEM;
+  size_t got = 0;
+  while (got < len) {
+    ssize_t r = pread(fd, M+got, len-got, got);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0) {
+      free(M);
+      return r? errno: EIO;
+    }
+    got += r;
+  }
+  uint8_t N[8] = {0};
+  MAC611_tag(ctx, M, len, N, tag);
+  free(M);
+  return 0;
+}
+
+static int mmap_tag (const struct MAC611_context * ctx, int fd, size_t len, uint8_t tag[8]) {
+  uint8_t N[8] = {0};
+  if (len == 0) {
+    MAC611_tag(ctx, N, 0, N, tag);
+    return 0;
+  }
+  void * m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED)
+    return errno;
+  madvise(m, len, MADV_SEQUENTIAL);
+  MAC611_tag(ctx, (const uint8_t *)m, len, N, tag);
+  munmap(m, len);
+  return 0;
+}
+
+static int stream_tag (const struct MAC611_context * ctx, int fd, enum tagstream_backend b,
+		       size_t buffer_size, uint8_t tag[8]) {
+  struct tagstream_options so = { buffer_size, BUFFERS, b };
+  uint8_t N[8] = {0};
+  lseek(fd, 0, SEEK_SET);
+  return tagstream_fd(ctx, fd, &so, N, tag, NULL);
+}
+
+// Temporary file with the bench_message pattern, unlinked on return
+static std::string make_file (size_t len) {
+  const char * dir = getenv("TMPDIR");
+  std::string name = std::string(dir? dir: "/tmp") + "/mac611_stream_XXXXXX";
+  int fd = mkstemp(&name[0]);
+  if (fd < 0)
+    return "";
+  uint8_t * M = bench_message(1<<20);
+  bool ok = M != NULL;
+  for (size_t l=0; ok && l<len; ) {
+    size_t n = std::min<size_t>(len-l, 1<<20);
+    ssize_t w = write(fd, M, n);
+    ok = w > 0;
+    l += ok? w: 0;
+  }
+  ok = ok && fdatasync(fd) == 0; // Clean pages can be dropped for -C
+  free(M);
+  close(fd);
+  if (!ok) {
+    unlink(name.c_str());
+    return "";
+  }
+  return name;
+}
+
+int bench_stream (const bench_options & o, bench_output & out) {
+  std::vector<std::string> files = o.args;
+  std::string tmp;
+  if (files.empty()) {
+    tmp = make_file(o.max_len? o.max_len: 256<<20);
+    if (tmp.empty()) {
+      fprintf(stderr, "bench: cannot create a temporary file\n");
+      return 1;
+    }
+    files.push_back(tmp);
+  }
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  size_t reps = o.reps? o.reps: 5;
+  int ret = 0;
+
+  for (const std::string & name : files) {
+    int fd = open(name.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+      fprintf(stderr, "bench: %s: %s\n", name.c_str(), strerror(errno));
+      ret = 1;
+      continue;
+    }
+    size_t len = st.st_size;
+    uint8_t ref[8];
+    if (int err = read_tag(&ctx, fd, len, ref)) {
+      fprintf(stderr, "bench: %s: %s\n", name.c_str(), strerror(err));
+      close(fd);
+      ret = 1;
+      continue;
+    }
+
+    struct method {
+      const char * name;
+      enum tagstream_backend backend;
+      size_t buffer_size;
+    };
+    std::vector<method> methods = { { "read", TAGSTREAM_AUTO, 0 }, { "mmap", TAGSTREAM_AUTO, 0 } };
+    for (enum tagstream_backend b : { TAGSTREAM_THREAD, TAGSTREAM_URING })
+      for (size_t bs : BUFFER_SIZES)
+	methods.push_back({ tagstream_backend_name(b), b, bs });
+
+    for (int cold=0; cold<=(int)o.cold; cold++) {
+      for (const method & m : methods) {
+	std::vector<uint64_t> t(reps);
+	int err = 0;
+	for (size_t r=0; r<reps && !err; r++) {
+	  if (cold)
+	    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	  uint8_t tag[8];
+	  uint64_t t0 = now_ns();
+	  err = !strcmp(m.name, "read")? read_tag(&ctx, fd, len, tag):
+	    !strcmp(m.name, "mmap")? mmap_tag(&ctx, fd, len, tag):
+	    stream_tag(&ctx, fd, m.backend, m.buffer_size, tag);
+	  t[r] = now_ns()-t0;
+	  if (!err && memcmp(tag, ref, 8)) {
+	    fprintf(stderr, "bench: %s: wrong tag with %s\n", name.c_str(), m.name);
+	    ret = 1;
+	    err = -1;
+	  }
+	}
+	if (err > 0)
+	  fprintf(stderr, "bench: %s: %s: %s\n", name.c_str(), m.name, strerror(err));
+	if (err)
+	  continue;
+
+	bench_stats s = bench_compute(t);
+	out.row({ F("file", name), F("cache", cold? "cold": "warm"), F("method", m.name),
+		  F("buffer", (uint64_t)m.buffer_size), F("buffers", (uint64_t)(m.buffer_size? BUFFERS: 0)),
+		  F("bytes", (uint64_t)len), F("reps", (uint64_t)reps),
+		  F("median_ns", s.median), F("min_ns", s.min),
+		  F("gbps", s.median? len/s.median: 0.0) });
+      }
+    }
+    close(fd);
+  }
+
+  if (!tmp.empty())
+    unlink(tmp.c_str());
+  bench_release(&ctx);
+  return ret;
+}
@@ -0,0 +1,145 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "threads": multi-thread scaling
+ * (c) 2018-2019 XXXX
+ *
+ * N threads (1, 2, 4, ... up to all CPUs) call MAC611_tag in a loop
+ * for a fixed time, each on its own message buffer, with
+ * - shared:  one context for all threads (read only, on its own
+ *            cache lines)
+ * - private: one context per thread, initialized by the thread
+ * Arguments are message lengths (default 64 1024 16384 1048576).
+ * With -c cpu, thread i is pinned to cpu+i (mod the CPU count);
+ * -c -1 leaves the placement to the scheduler.
+ * Columns: aggregate GB/s and messages/s, and the efficiency
+ * relative to N times the single-thread throughput.
+ * With arm-tables, the tables of a shared context are read by
+ * all threads; tags of more than TABLE_CACHE rekeys also build
+ * tables in per-call scratch memory.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+
+#include "bench.h"
+
+#define RUN_NS 300000000 // Run time per measurement (ns)
+
+// Per-thread results, one cache line each
+struct alignas(64) worker {
+  uint64_t calls;
+  int error;
+};
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void run (int id, int cpu, size_t len, const struct MAC611_context * shared,
+		 std::atomic<int> * ready, std::atomic<bool> * go, std::atomic<bool> * stop,
+		 worker * w) {
+  if (cpu >= 0)
+    bench_pin(cpu);
+
+  uint8_t * M = bench_message(len);
+  struct MAC611_context * own = NULL;
+  if (!shared) {
+    own = (struct MAC611_context *)aligned_alloc(64, (sizeof(*own)+63)/64*64);
+    if (own)
+      bench_init(own);
+  }
+  const struct MAC611_context * ctx = shared? shared: own;
+  w->error = !M || !ctx;
+
+  uint8_t N[8] = { (uint8_t)id };
+  uint8_t tag[8];
+  uint64_t calls = 0;
+  ready->fetch_add(1);
+  while (!go->load(std::memory_order_acquire))
+    ;
+  if (!w->error) {
+    while (!stop->load(std::memory_order_relaxed)) {
+      MAC611_tag(ctx, M, len, N, tag);
+      calls++;
+    }
+  }
+  bench_keep(tag);
+  w->calls = calls;
+
+  if (own) {
+    bench_release(own);
+    free(own);
+  }
+  free(M);
+}
+
+int bench_threads (const bench_options & o, bench_output & out) {
+  std::vector<size_t> lengths;
+  for (const std::string & a : o.args)
+    lengths.push_back(strtoull(a.c_str(), NULL, 0));
+  if (lengths.empty())
+    lengths = { 64, 1024, 16384, 1<<20 };
+
+  int ncpu = std::thread::hardware_concurrency();
+  if (ncpu < 1)
+    ncpu = 1;
+  std::vector<int> counts;
+  for (int n=1; n<ncpu; n*=2)
+    counts.push_back(n);
+  counts.push_back(ncpu);
+
+  struct MAC611_context * shared = (struct MAC611_context *)aligned_alloc(64, (sizeof(*shared)+63)/64*64);
+  if (!shared)
+    return 1;
+  bench_init(shared);
+
+  int ret = 0;
+  for (size_t len : lengths) {
+    for (int priv=0; priv<2; priv++) {
+      double single = 0;
+      for (int n : counts) {
+	std::vector<worker> w(n);
+	std::vector<std::thread> th;
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false), stop(false);
+
+	for (int i=0; i<n; i++)
+	  th.push_back(std::thread(run, i, o.cpu >= 0? (o.cpu+i)%ncpu: -1, len,
+				   priv? (const struct MAC611_context *)NULL: shared,
+				   &ready, &go, &stop, &w[i]));
+	while (ready.load() < n)
+	  std::this_thread::yield();
+
+	double t0 = now();
+	go.store(true, std::memory_order_release);
+	struct timespec run_time = { 0, RUN_NS };
+	nanosleep(&run_time, NULL);
+	stop.store(true);
+	for (std::thread & t : th)
+	  t.join();
+	double t1 = now();
+
+	uint64_t calls = 0;
+	for (worker & x : w) {
+	  calls += x.calls;
+	  ret |= x.error;
+	}
+	double msgs = calls/(t1-t0);
+	if (n == 1)
+	  single = msgs;
+	out.row({ F("context", priv? "private": "shared"), F("threads", (uint64_t)n),
+		  F("len", (uint64_t)len), F("calls", calls), F("seconds", t1-t0),
+		  F("gbps", msgs*len/1e9), F("msgs_per_s", msgs),
+		  F("efficiency", single? msgs/(n*single): 0.0) });
+      }
+    }
+  }
+
+  bench_release(shared);
+  free(shared);
+  return ret;
+}
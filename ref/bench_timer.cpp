@@ -0,0 +1,43 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Timer calibration: overhead of a bench_start/bench_stop pair and
+ * ticks per second. Also linked into bench_engine and, in
+ * arm-tables, bench_tables.
+ * (c) 2018-2019 XXXX
+ ************************************************************/
+
+#include <time.h>
+#include <algorithm>
+
+#include "bench.h"
+
+/*** Timer ***/
+
+uint64_t bench_overhead (void) {
+  static uint64_t overhead = 0;
+  if (!overhead) {
+    uint64_t best = ~0ULL;
+    for (int i=0; i<10000; i++) {
+      uint64_t t0 = bench_start();
+      uint64_t t1 = bench_stop();
+      best = std::min(best, t1-t0);
+    }
+    overhead = best? best: 1;
+  }
+  return overhead == 1? 0: overhead;
+}
+
+double bench_tick_rate (void) {
+  static double rate = 0;
+  if (rate == 0) {
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    uint64_t t0 = bench_start();
+    do {
+      clock_gettime(CLOCK_MONOTONIC, &b);
+    } while ((b.tv_sec-a.tv_sec)*1e9 + (b.tv_nsec-a.tv_nsec) < 50e6);
+    uint64_t t1 = bench_stop();
+    rate = (t1-t0) / ((b.tv_sec-a.tv_sec) + (b.tv_nsec-a.tv_nsec)*1e-9);
+  }
+  return rate;
+}
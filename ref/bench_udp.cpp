@@ -0,0 +1,200 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "udp": load generator for mac611d
+ * (c) 2018-2019 XXXX
+ *
+ * Arguments: [host:port [sign|verify [keyfile]]], by default
+ * 127.0.0.1:6110 sign. Packets of 8, 64, 256, 1024 and 1400
+ * payload bytes (within -s/-m) are sent in batches with sendmmsg,
+ * keeping up to WINDOW packets in flight, for RUN_NS each. The
+ * payload starts with the send time, so the latency of each
+ * answer is its round trip through the daemon. With a key file,
+ * the tags of signed answers are checked, and packets for a
+ * verifying daemon are tagged (required).
+ * Columns: packets sent, answered, lost and bad, answers/s,
+ * payload GB/s and round-trip percentiles (ns).
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "keyfile.h"
+#include "toolutil.h"
+
+#define RUN_NS   1000000000ULL // Per packet size
+#define LOST_NS  100000000ULL  // No answer for that long: the window is lost
+#define WINDOW   256
+#define BATCH    32
+#define MAX_PACKET 2048
+
+static const size_t PAYLOADS[] = { 8, 64, 256, 1024, 1400 };
+
+static int connect_to (const std::string & spec) {
+  size_t colon = spec.rfind(':');
+  std::string host = colon == std::string::npos? "127.0.0.1": spec.substr(0, colon);
+  std::string port = colon == std::string::npos? spec: spec.substr(colon+1);
+  if (host.size() > 1 && host[0] == '[' && host.back() == ']')
+    host = host.substr(1, host.size()-2);
+
+  struct addrinfo hints, * res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (err) {
+    fprintf(stderr, "bench: %s: %s\n", spec.c_str(), gai_strerror(err));
+    return -1;
+  }
+  int fd = socket(res->ai_family, SOCK_DGRAM, 0);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen)) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    perror("bench: udp socket");
+    return -1;
+  }
+  struct timeval tv = { 0, 10000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  int buf = 4<<20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+  return fd;
+}
+
+int bench_udp (const bench_options & o, bench_output & out) {
+  std::string target = o.args.size() > 0? o.args[0]: "127.0.0.1:6110";
+  bool verify = o.args.size() > 1 && o.args[1] == "verify";
+  if (o.args.size() > 1 && !verify && o.args[1] != "sign") {
+    fprintf(stderr, "bench: udp mode must be sign or verify\n");
+    return 2;
+  }
+
+  struct MAC611_context ctx;
+  bool keyed = o.args.size() > 2;
+  if (keyed) {
+    uint8_t k[16];
+    int err = keyfile_load(o.args[2].c_str(), k);
+    if (err) {
+      fprintf(stderr, "bench: %s: %s\n", o.args[2].c_str(), strerror(err));
+      return 2;
+    }
+    MAC611_init(&ctx, k);
+  } else if (verify) {
+    fprintf(stderr, "bench: udp verify needs the key file of the daemon\n");
+    return 2;
+  }
+
+  int fd = connect_to(target);
+  if (fd < 0)
+    return 1;
+  out.meta("target", target);
+  out.meta("daemon_mode", verify? "verify": "sign");
+
+  static uint8_t tx[BATCH][MAX_PACKET], rx[BATCH][MAX_PACKET];
+  struct mmsghdr tmsg[BATCH], rmsg[BATCH];
+  struct iovec tiov[BATCH], riov[BATCH];
+  memset(tmsg, 0, sizeof(tmsg));
+  memset(rmsg, 0, sizeof(rmsg));
+  for (int i=0; i<BATCH; i++) {
+    tiov[i].iov_base = tx[i];
+    tmsg[i].msg_hdr.msg_iov = &tiov[i];
+    tmsg[i].msg_hdr.msg_iovlen = 1;
+    riov[i].iov_base = rx[i];
+    riov[i].iov_len = MAX_PACKET;
+    rmsg[i].msg_hdr.msg_iov = &riov[i];
+    rmsg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  static bench_histogram h;
+  uint64_t seq = 0;
+  for (size_t payload : PAYLOADS) {
+    if (payload < o.min_len || (o.max_len && payload > o.max_len))
+      continue;
+    size_t send_len = 8 + payload + (verify? 8: 0);
+    size_t answer_len = 8 + payload + (verify? 0: 8);
+    for (int i=0; i<BATCH; i++) {
+      memset(tx[i], 0xa5, send_len);
+      tiov[i].iov_len = send_len;
+    }
+
+    h.reset();
+    uint64_t sent = 0, answered = 0, lost = 0, bad = 0, inflight = 0;
+    uint64_t start = now_ns(), end = start + RUN_NS, last_answer = start, t;
+    while ((t = now_ns()) < end || (inflight && t < last_answer + LOST_NS)) {
+      // Fill the window
+      while (t < end && inflight + BATCH <= WINDOW) {
+	for (int i=0; i<BATCH; i++) {
+	  put64(tx[i], seq++);             // Nonce
+	  put64(tx[i]+8, now_ns());        // Send time
+	  if (verify)
+	    MAC611_tag(&ctx, tx[i]+8, payload, tx[i], tx[i]+8+payload);
+	}
+	int n = sendmmsg(fd, tmsg, BATCH, 0);
+	if (n < 0) {
+	  if (errno == ECONNREFUSED) {
+	    fprintf(stderr, "bench: no daemon on %s\n", target.c_str());
+	    close(fd);
+	    return 1;
+	  }
+	  break; // ENOBUFS: let the answers drain
+	}
+	sent += n;
+	inflight += n;
+	if (n < BATCH)
+	  break;
+      }
+
+      int n = recvmmsg(fd, rmsg, BATCH, MSG_WAITFORONE, NULL);
+      t = now_ns();
+      if (n <= 0) {
+	if (n < 0 && errno == ECONNREFUSED) {
+	  fprintf(stderr, "bench: no daemon on %s\n", target.c_str());
+	  close(fd);
+	  return 1;
+	}
+	if (t - last_answer > LOST_NS) {
+	  lost += inflight;
+	  inflight = 0;
+	  last_answer = t;
+	}
+	continue;
+      }
+      last_answer = t;
+      for (int i=0; i<n; i++) {
+	const uint8_t * p = rx[i];
+	if (rmsg[i].msg_len != answer_len) {
+	  bad++;
+	} else {
+	  if (keyed && !verify) {
+	    uint8_t tag[8];
+	    MAC611_tag(&ctx, p+8, payload, p, tag);
+	    if (memcmp(tag, p+8+payload, 8))
+	      bad++;
+	  }
+	  h.record(t - read64(p+8));
+	}
+	answered++;
+      }
+      inflight = inflight > (uint64_t)n? inflight-n: 0;
+    }
+    lost += inflight;
+
+    double seconds = (t-start)*1e-9;
+    out.row({ F("payload", (uint64_t)payload), F("sent", sent), F("answered", answered),
+	      F("lost", lost), F("bad", bad),
+	      F("pps", answered/seconds), F("gbps", answered*payload/seconds/1e9),
+	      F("p50_ns", h.quantile(0.5)), F("p99_ns", h.quantile(0.99)),
+	      F("p999_ns", h.quantile(0.999)), F("max_ns", h.max()) });
+  }
+
+  close(fd);
+  return 0;
+}
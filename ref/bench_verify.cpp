@@ -0,0 +1,117 @@
+/************************************************************
+ * MAC611 host benchmark harness
+ * Mode "verify": batch verification (tagbatch.h)
+ * (c) 2018-2019 XXXX
+ *
+ * Arguments: message lengths (default 16 64 256 1024 4096), then
+ * with several lengths a mixed case (len 0): each message takes
+ * one of them at random, in arrival order.
+ * Batches of BATCH messages, one tag in 97 wrong, for RUN_NS:
+ * - loop: MAC611_verify of each message by the calling thread
+ * - batch: tagbatch_verify with 1 to all online CPUs
+ * Columns: messages/s, GB/s and the failed messages per batch
+ * (the bitmap is checked against the wrong tags).
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "tagbatch.h"
+#include "toolutil.h"
+
+#define BATCH  4096
+#define RUN_NS 300000000ULL
+
+int bench_verify (const bench_options & o, bench_output & out) {
+  std::vector<size_t> lens;
+  for (const std::string & a : o.args)
+    lens.push_back(strtoull(a.c_str(), NULL, 0));
+  if (lens.empty())
+    lens = { 16, 64, 256, 1024, 4096 };
+
+  struct MAC611_context ctx;
+  bench_init(&ctx);
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int ret = 0;
+
+  std::vector<tagbatch_item> items(BATCH);
+  std::vector<uint8_t> meta(BATCH*16);
+  std::vector<uint64_t> pass((BATCH+63)/64);
+
+  // Mixed case last: len 0
+  size_t max_len = *std::max_element(lens.begin(), lens.end());
+  std::vector<size_t> cases = lens;
+  if (lens.size() > 1)
+    cases.push_back(0);
+
+  for (size_t len : cases) {
+    // Each message has its own buffer, as received
+    uint8_t * M = bench_message(BATCH*(len? len: max_len));
+    if (!M) {
+      ret = 1;
+      break;
+    }
+    size_t wrong = 0, bytes = 0;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (size_t i=0; i<BATCH; i++) {
+      uint8_t * nonce = &meta[16*i], * tag = nonce+8, * m = M + i*(len? len: max_len);
+      seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+      size_t l = len? len: lens[(seed >> 33) % lens.size()];
+      memcpy(nonce, &i, 8);
+      MAC611_tag(&ctx, m, l, nonce, tag);
+      if (i % 97 == 0) {
+	tag[i % 8] ^= 1;
+	wrong++;
+      }
+      items[i] = { m, l, nonce, tag };
+      bytes += l;
+    }
+
+    // threads 0: the loop
+    for (int threads = 0; threads <= ncpu; threads = threads < ncpu && 2*threads > ncpu? ncpu: threads? 2*threads: 1) {
+      struct tagbatch * b = threads? tagbatch_create(&ctx, threads): NULL;
+      if (threads && !b) {
+	perror("bench: tagbatch_create");
+	ret = 1;
+	break;
+      }
+      uint64_t batches = 0, failed = 0, start = now_ns(), end = start + RUN_NS;
+      while (now_ns() < end) {
+	size_t ok = 0;
+	if (b) {
+	  ok = tagbatch_verify(b, items.data(), BATCH, pass.data());
+	} else {
+	  memset(pass.data(), 0, pass.size()*8);
+	  for (size_t i=0; i<BATCH; i++) {
+	    int v = MAC611_verify(&ctx, items[i].m, items[i].len, items[i].nonce, items[i].tag);
+	    pass[i/64] |= (uint64_t)v << (i%64);
+	    ok += v;
+	  }
+	}
+	failed += BATCH - ok;
+	batches++;
+      }
+      double seconds = (now_ns()-start)*1e-9;
+      for (size_t i=0; i<BATCH; i++)
+	if ((pass[i/64] >> (i%64) & 1) != (i % 97 != 0)) {
+	  fprintf(stderr, "bench: verify: wrong result for message %zu\n", i);
+	  ret = 1;
+	  break;
+	}
+      if (b)
+	tagbatch_destroy(b);
+
+      out.row({ F("engine", threads? "batch": "loop"), F("len", (uint64_t)len), F("threads", (uint64_t)(threads? threads: 1)),
+		F("msgs_per_s", batches*BATCH/seconds), F("gbps", batches*bytes/seconds/1e9),
+		F("failed", batches? (double)failed/batches: 0.0), F("wrong", (uint64_t)wrong) });
+    }
+    free(M);
+  }
+
+  bench_release(&ctx);
+  return ret;
+}
@@ -164,6 +164,18 @@ void MACtest(const struct MAC611_context *ctx, uint8_t *m, size_t len, const uin
   printf ("\r\n");
 }
 
+// MAC611_init, stopping on a failure (allocation of the tables of arm-tables)
+void init(struct MAC611_context *ctx, const uint8_t k[16]) {
+#ifdef MAC611_TABLES_BYTES
+  if (MAC611_init(ctx, k)) {
+    printf("MAC611_init failed!\r\n");
+    exit(-1);
+  }
+#else
+  MAC611_init(ctx, k);
+#endif
+}
+
 int main()
 {
   printf ("\r\n########################################\r\n"
@@ -223,7 +235,7 @@ after NESSIEencrypt, b = e2f687e0 7b75660f fc372233 bc47532c
   uint8_t k[16] = {  0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
   		     0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 };
   struct MAC611_context ctx;
-  MAC611_init(&ctx, k);
+  init(&ctx, k);
 
 #define MLEN 7200 // > 7*LAMBDA
   uint8_t *M = (uint8_t*)malloc(MLEN);
@@ -259,10 +271,16 @@ after NESSIEencrypt, b = e2f687e0 7b75660f fc372233 bc47532c
   for (int i=7168-8; i<=7168+16; i++) {
     N = i;
     k[0] = N;
-    MAC611_init(&ctx, k);
+#ifdef MAC611_TABLES_BYTES
+    MAC611_free(&ctx); // Release tables of the table-based version
+#endif
+    init(&ctx, k);
     MACtest(&ctx, M, N, (uint8_t*)&N);
   }
 
+#ifdef MAC611_TABLES_BYTES
+  MAC611_free(&ctx);
+#endif
   free(M);
   return 0;
 }
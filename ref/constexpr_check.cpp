@@ -0,0 +1,96 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Check of the compile-time key material (MAC611_constexpr.hpp)
+ * (c) 2018-2019 XXXX
+ *
+ * The constant context of a fixed key (and with arm-tables, its
+ * multiplication tables) must be the one computed by MAC611_init,
+ * the rekey schedule the one of MAC611_tag, and both contexts must
+ * give the same tags for lengths around the block and rekey
+ * boundaries. Built by "make constexpr-check" in ref and in
+ * arm-tables; exit status 1 on a mismatch.
+ ************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "MAC611.h"
+#include "MAC611_constexpr.hpp"
+
+static constexpr mac611::key_t K = {{ 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+				      0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 }};
+
+#define KEYS 4 // Rekey schedule checked: keys 0..KEYS-1
+
+#ifdef MAC611_TABLES_BYTES
+static constexpr auto T = mac611::mul_tables<TABLE_BITS, TABLE_CACHE+1>(K);
+static constexpr MAC611_context CTX = mac611::make_table_context<MAC611_context>(K, T);
+#else
+static constexpr MAC611_context CTX = mac611::make_context<MAC611_context>(K);
+#endif
+static constexpr auto SCHEDULE = mac611::hash_keys<KEYS>(K);
+static_assert(CTX.hash_key == SCHEDULE.k[0], "first hash key");
+
+// Around 0, one block, and the first rekeys (the partial block counts)
+static const size_t LENS[] = { 0, 1, 6, 7, 8, 13, 14, 15,
+			       7*LAMBDA-7, 7*LAMBDA-6, 7*LAMBDA-1, 7*LAMBDA, 7*LAMBDA+1, 7*LAMBDA+7,
+			       14*LAMBDA-6, 14*LAMBDA-1, 14*LAMBDA, 14*LAMBDA+1,
+			       21*LAMBDA-6, 21*LAMBDA, 21*LAMBDA+1,
+			       28*LAMBDA-6, 28*LAMBDA, 28*LAMBDA+1, 35*LAMBDA+3 };
+#define MAX_LEN (35*LAMBDA+3)
+
+static uint8_t M[MAX_LEN];
+
+int main (void) {
+  int errors = 0;
+  struct MAC611_context ctx;
+#ifdef MAC611_TABLES_BYTES
+  if (MAC611_init(&ctx, K.b)) {
+    fprintf(stderr, "constexpr-check: MAC611_init failed\n");
+    return 1;
+  }
+  if (memcmp(T.t, ctx.mul_table, sizeof(T.t))) {
+    fprintf(stderr, "constexpr-check: mul_tables differ from MAC611_init\n");
+    errors++;
+  }
+#else
+  MAC611_init(&ctx, K.b);
+  if (ctx.hash_key != CTX.hash_key) {
+    fprintf(stderr, "constexpr-check: hash_key differs from MAC611_init\n");
+    errors++;
+  }
+#endif
+  if (memcmp(ctx.noekeon_key, CTX.noekeon_key, 16)) {
+    fprintf(stderr, "constexpr-check: noekeon_key differs from MAC611_init\n");
+    errors++;
+  }
+
+  // Rekey schedule: as in MAC611_tag
+  for (uint64_t k=0; k<KEYS; k++) {
+    uint8_t tmp[16] = { 0, 0, 0, 0, 0, 0, 0, 0, write64(k) };
+    Noekeon_encrypt(K.b, tmp, tmp);
+    if (read64(tmp) % MOD611 != SCHEDULE.k[k]) {
+      fprintf(stderr, "constexpr-check: hash key %llu differs\n", (unsigned long long)k);
+      errors++;
+    }
+  }
+
+  for (size_t i=0; i<MAX_LEN; i++)
+    M[i] = i*7 + 1;
+  for (size_t len : LENS) {
+    uint8_t N[8] = { write64(len) }, a[8], b[8];
+    MAC611_tag(&ctx, M, len, N, a);
+    MAC611_tag(&CTX, M, len, N, b);
+    if (memcmp(a, b, 8)) {
+      fprintf(stderr, "constexpr-check: tag differs for %zu bytes\n", len);
+      errors++;
+    }
+  }
+
+#ifdef MAC611_TABLES_BYTES
+  MAC611_free(&ctx);
+#endif
+  if (errors)
+    return 1;
+  printf("constexpr-check: %zu lengths OK\n", sizeof(LENS)/sizeof(LENS[0]));
+  return 0;
+}
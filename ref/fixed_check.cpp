@@ -0,0 +1,71 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Check of the length-specialized tags (MAC611_fixed.hpp)
+ * (c) 2018-2019 XXXX
+ *
+ * tag_fixed<N> must give the tag of MAC611_tag for lengths around
+ * 0, one block and the first rekeys (7*LAMBDA-byte boundaries),
+ * through both the unrolled and the looped code, and mac611::tag
+ * for every length it dispatches. Built with the benchmark flags
+ * (-O3) by "make fixed-check"; exit status 1 on a mismatch.
+ ************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include "MAC611_fixed.hpp"
+
+#define MAX_LEN (21*LAMBDA+8)
+
+static uint8_t M[MAX_LEN];
+static struct MAC611_context ctx;
+static int errors = 0, checked = 0;
+
+template <size_t N>
+static void check (void) {
+  uint8_t nonce[8] = { write64((uint64_t)N) }, a[8], b[8];
+  // Message at the end of the buffer: reads beyond it would be caught by ASan
+  const uint8_t * m = M + MAX_LEN - N;
+  MAC611_tag(&ctx, m, N, nonce, a);
+  mac611::tag_fixed<N>(&ctx, m, nonce, b);
+  if (memcmp(a, b, 8)) {
+    fprintf(stderr, "fixed-check: tag_fixed<%zu> differs from MAC611_tag\n", N);
+    errors++;
+  }
+  checked++;
+}
+
+template <size_t... N>
+static void check_all (std::index_sequence<N...>) {
+  (check<N>(), ...);
+}
+
+int main (void) {
+  MAC611_init(&ctx, (const uint8_t *)"MAC611 fixed-len");
+  for (size_t i=0; i<MAX_LEN; i++)
+    M[i] = i*13 + 5;
+
+  // 0 to 16 bytes, unrolled
+  check_all(std::make_index_sequence<17>());
+  // Largest unrolled message and the first looped ones
+  check_all(std::index_sequence<7*mac611::UNROLL_MAX-1, 7*mac611::UNROLL_MAX, 7*mac611::UNROLL_MAX+1>());
+  // Rekeys: the partial block counts towards the key lifetime
+  check_all(std::index_sequence<7*LAMBDA-7, 7*LAMBDA-6, 7*LAMBDA-1, 7*LAMBDA, 7*LAMBDA+1, 7*LAMBDA+7, 7*LAMBDA+8,
+				14*LAMBDA-6, 14*LAMBDA-1, 14*LAMBDA, 14*LAMBDA+1, 21*LAMBDA, 21*LAMBDA+1>());
+
+  // Dispatch of mac611::tag
+  for (size_t len=0; len<=600; len++) {
+    uint8_t nonce[8] = { write64((uint64_t)len) }, a[8], b[8];
+    MAC611_tag(&ctx, M, len, nonce, a);
+    mac611::tag(&ctx, M, len, nonce, b);
+    if (memcmp(a, b, 8)) {
+      fprintf(stderr, "fixed-check: mac611::tag differs for %zu bytes\n", len);
+      errors++;
+    }
+  }
+
+  if (errors)
+    return 1;
+  printf("fixed-check: %d lengths OK\n", checked);
+  return 0;
+}
@@ -0,0 +1,49 @@
+/************************************************************
+ * MAC611 tools
+ * Key files: 16 raw bytes, or 32 hex digits (and a newline)
+ * (c) 2018-2019 XXXX
+ ************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "keyfile.h"
+
+static int hexval (char c) {
+  return c >= '0' && c <= '9'? c-'0': c >= 'a' && c <= 'f'? c-'a'+10: c >= 'A' && c <= 'F'? c-'A'+10: -1;
+}
+
+int keyfile_unhex (uint8_t * x, const char * s, size_t n) {
+  for (size_t i=0; i<n; i++) {
+    int h = hexval(s[2*i]), l = hexval(s[2*i+1]);
+    if (h < 0 || l < 0)
+      return -1;
+    x[i] = h<<4 | l;
+  }
+  return 0;
+}
+
+int keyfile_load (const char * file, uint8_t k[16]) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return errno;
+  char buf[64];
+  ssize_t n = read(fd, buf, sizeof(buf)-1);
+  int err = n < 0? errno: 0;
+  close(fd);
+  if (err)
+    return err;
+
+  if (n == 16) {
+    memcpy(k, buf, 16);
+    memset(buf, 0, sizeof(buf));
+    return 0;
+  }
+  while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == '\r'))
+    n--;
+  err = n != 32 || keyfile_unhex(k, buf, 16)? EINVAL: 0;
+  memset(buf, 0, sizeof(buf));
+  return err;
+}
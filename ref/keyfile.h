@@ -0,0 +1,27 @@
+/************************************************************
+ * MAC611 tools
+ * Key files: 16 raw bytes, or 32 hex digits (and a newline)
+ * (c) 2018-2019 XXXX
+ ************************************************************/
+
+#ifndef KEYFILE_H
+#define KEYFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns 0, an errno value, or EINVAL for a malformed file
+int keyfile_load (const char * file, uint8_t k[16]);
+
+// n bytes from 2n hex digits, returns -1 on a non-hex digit
+int keyfile_unhex (uint8_t * x, const char * s, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KEYFILE_H
@@ -0,0 +1,377 @@
+/************************************************************
+ * MAC611 tools
+ * mac611d: batched UDP packet authenticator
+ * (c) 2018-2019 XXXX
+ *
+ * Packets are "nonce (8 bytes) || payload", the tag covers the
+ * payload with the nonce of the packet:
+ * - sign (default): nonce || payload  ->  nonce || payload || tag
+ * - verify (-V):    nonce || payload || tag  ->  nonce || payload,
+ *                   packets with a wrong tag are dropped
+ * Results are sent back to the source of each packet, or to the
+ * address given with -f.
+ *
+ * Each worker thread has its own socket on the same port
+ * (SO_REUSEPORT, the kernel spreads the flows), pinned to its own
+ * CPU. Packets are received with recvmmsg and sent with sendmmsg
+ * in batches of up to -B packets. Each batch is signed four
+ * packets at a time with MAC611_tag_x4, or verified with the
+ * batch engine of the worker (tagbatch.h, no pool: the workers
+ * are the parallelism).
+ * Busy polling: -b usec sets SO_BUSY_POLL (the kernel polls the
+ * device queue in recvmmsg), -s spins on non-blocking recvmmsg.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "MAC611.h"
+#include "keyfile.h"
+#include "tagbatch.h"
+
+#define MAX_BATCH 1024
+#define MAX_PACKET 2048 // Including the tag
+
+struct worker {
+  pthread_t thread;
+  int id, cpu, fd;
+  uint64_t rx, tx, bad, dropped; // Read by the main thread (relaxed)
+} __attribute__((aligned(64)));
+
+static struct MAC611_context ctx;
+static int verify = 0, spin = 0, batch = 64;
+static struct sockaddr_storage forward;
+static socklen_t forward_len = 0;
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal (int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+static int resolve (const char * spec, const char * default_host, struct sockaddr_storage * a, socklen_t * len, int passive) {
+  char host[256];
+  const char * port = strrchr(spec, ':');
+  if (port) {
+    snprintf(host, sizeof(host), "%.*s", (int)(port-spec), spec);
+    port++;
+  } else {
+    snprintf(host, sizeof(host), "%s", default_host? default_host: "");
+    port = spec;
+  }
+  // [v6 address]
+  char * h = host;
+  if (h[0] == '[' && h[strlen(h)-1] == ']') {
+    h[strlen(h)-1] = 0;
+    h++;
+  }
+  struct addrinfo hints, * res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = passive? AI_PASSIVE: 0;
+  int err = getaddrinfo(h[0]? h: NULL, port, &hints, &res);
+  if (err) {
+    fprintf(stderr, "mac611d: %s: %s\n", spec, gai_strerror(err));
+    return -1;
+  }
+  memcpy(a, res->ai_addr, res->ai_addrlen);
+  *len = res->ai_addrlen;
+  freeaddrinfo(res);
+  return 0;
+}
+
+static int open_socket (const struct sockaddr_storage * a, socklen_t len, int busy_poll) {
+  int fd = socket(a->ss_family, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) ||
+      bind(fd, (const struct sockaddr *)a, len)) {
+    close(fd);
+    return -1;
+  }
+  // Wake up regularly to see the stop flag
+  struct timeval tv = { 0, 100000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  int rcvbuf = 4<<20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  if (busy_poll > 0) {
+#ifdef SO_BUSY_POLL
+    // Above net.core.busy_read, CAP_NET_ADMIN is needed
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)))
+      perror("mac611d: SO_BUSY_POLL");
+#endif
+#ifdef SO_PREFER_BUSY_POLL
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+#ifdef SO_BUSY_POLL_BUDGET
+    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &batch, sizeof(batch));
+#endif
+  }
+  return fd;
+}
+
+// Signs the packets p[0..n-1] of lengths len (nonce || payload) in
+// place: the tag is appended after the payload
+static void sign (uint8_t * const * p, const size_t * len, int n) {
+  int i = 0;
+  for (; i+4 <= n; i += 4) {
+    const uint8_t * m[4], * nonce[4];
+    size_t l[4];
+    uint8_t * tag[4];
+    for (int j=0; j<4; j++) {
+      m[j] = p[i+j]+8;
+      l[j] = len[i+j]-8;
+      nonce[j] = p[i+j];
+      tag[j] = p[i+j]+len[i+j];
+    }
+    MAC611_tag_x4(&ctx, m, l, nonce, tag);
+  }
+  for (; i<n; i++)
+    MAC611_tag(&ctx, p[i]+8, len[i]-8, p[i], p[i]+len[i]);
+}
+
+static void * worker_run (void * arg) {
+  struct worker * w = arg;
+  if (w->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  uint8_t (* buf)[MAX_PACKET] = aligned_alloc(64, (size_t)batch*MAX_PACKET);
+  struct mmsghdr * in = calloc(batch, sizeof(*in));
+  struct mmsghdr * out = calloc(batch, sizeof(*out));
+  struct iovec * iov = calloc(batch, sizeof(*iov));
+  struct iovec * oiov = calloc(batch, sizeof(*oiov));
+  struct sockaddr_storage * src = calloc(batch, sizeof(*src));
+  // Well-formed packets of a batch: index, start and length
+  int * idx = calloc(batch, sizeof(*idx));
+  uint8_t ** pkt = calloc(batch, sizeof(*pkt));
+  size_t * plen = calloc(batch, sizeof(*plen));
+  struct tagbatch_item * items = calloc(batch, sizeof(*items));
+  uint64_t * pass = calloc((batch+63)/64, sizeof(*pass));
+  struct tagbatch * tb = verify? tagbatch_create(&ctx, 1): NULL;
+  if (!buf || !in || !out || !iov || !oiov || !src || !idx || !pkt || !plen || !items || !pass || (verify && !tb)) {
+    fprintf(stderr, "mac611d: out of memory\n");
+    stop = 1;
+    return NULL;
+  }
+
+  // Room for the tag when signing: longer packets are truncated (dropped)
+  size_t room = verify? MAX_PACKET: MAX_PACKET-8;
+  for (int i=0; i<batch; i++) {
+    iov[i].iov_base = buf[i];
+    iov[i].iov_len = room;
+    in[i].msg_hdr.msg_iov = &iov[i];
+    in[i].msg_hdr.msg_iovlen = 1;
+    in[i].msg_hdr.msg_name = &src[i];
+  }
+
+  while (!stop) {
+    for (int i=0; i<batch; i++)
+      in[i].msg_hdr.msg_namelen = sizeof(src[i]);
+    int n = recvmmsg(w->fd, in, batch, spin? MSG_DONTWAIT: MSG_WAITFORONE, NULL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	continue;
+      perror("mac611d: recvmmsg");
+      break;
+    }
+
+    int k = 0;
+    for (int i=0; i<n; i++) {
+      size_t len = in[i].msg_len;
+      if (in[i].msg_hdr.msg_flags & MSG_TRUNC || len < (verify? 16: 8)) {
+	w->dropped++;
+	continue;
+      }
+      idx[k] = i;
+      pkt[k] = buf[i];
+      plen[k] = len;
+      // nonce || payload || tag
+      if (verify)
+	items[k] = (struct tagbatch_item){ buf[i]+8, len-16, buf[i], buf[i]+len-8 };
+      k++;
+    }
+    if (verify)
+      tagbatch_verify(tb, items, k, pass);
+    else
+      sign(pkt, plen, k);
+
+    int m = 0;
+    for (int j=0; j<k; j++) {
+      int i = idx[j];
+      if (verify && !(pass[j/64] >> (j%64) & 1)) {
+	w->bad++;
+	continue;
+      }
+      size_t len = verify? plen[j]-8: plen[j]+8;
+      oiov[m].iov_base = buf[i];
+      oiov[m].iov_len = len;
+      memset(&out[m].msg_hdr, 0, sizeof(out[m].msg_hdr));
+      out[m].msg_hdr.msg_iov = &oiov[m];
+      out[m].msg_hdr.msg_iovlen = 1;
+      out[m].msg_hdr.msg_name = forward_len? (void *)&forward: (void *)&src[i];
+      out[m].msg_hdr.msg_namelen = forward_len? forward_len: in[i].msg_hdr.msg_namelen;
+      m++;
+    }
+
+    int sent = 0;
+    while (sent < m) {
+      int r = sendmmsg(w->fd, out+sent, m-sent, 0);
+      if (r < 0 && errno == EINTR)
+	continue;
+      if (r < 0) {
+	w->dropped += m-sent; // E.g. ECONNREFUSED, ENOBUFS
+	break;
+      }
+      sent += r;
+    }
+    __atomic_store_n(&w->rx, w->rx+n, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->tx, w->tx+sent, __ATOMIC_RELAXED);
+  }
+
+  free(buf);
+  free(in);
+  free(out);
+  free(iov);
+  free(oiov);
+  free(src);
+  free(idx);
+  free(pkt);
+  free(plen);
+  free(items);
+  free(pass);
+  if (tb)
+    tagbatch_destroy(tb);
+  return NULL;
+}
+
+static void usage (void) {
+  fprintf(stderr,
+	  "Usage: mac611d -k keyfile [options]\n"
+	  "  -k FILE       key: 16 raw bytes or 32 hex digits\n"
+	  "  -l [ADDR:]PORT listen address (default 6110, all addresses)\n"
+	  "  -f HOST:PORT  forward the results there (default: back to the source)\n"
+	  "  -V            verify and strip the tags (default: sign)\n"
+	  "  -t N          worker threads and sockets (default: online CPUs)\n"
+	  "  -c CPU        pin worker i to CPU+i (default 0, -1: no pinning)\n"
+	  "  -B N          packets per recvmmsg/sendmmsg (default 64)\n"
+	  "  -b USEC       SO_BUSY_POLL time\n"
+	  "  -s            spin on non-blocking recvmmsg\n"
+	  "  -v            print the packet rates every second\n");
+  exit(2);
+}
+
+int main (int argc, char * argv[]) {
+  const char * keyfile = NULL, * listen_on = "6110", * forward_to = NULL;
+  int threads = 0, cpu = 0, busy_poll = 0, verbose = 0, c;
+
+  while ((c = getopt(argc, argv, "k:l:f:Vt:c:B:b:svh")) != -1) {
+    switch (c) {
+    case 'k': keyfile = optarg; break;
+    case 'l': listen_on = optarg; break;
+    case 'f': forward_to = optarg; break;
+    case 'V': verify = 1; break;
+    case 't': threads = atoi(optarg); break;
+    case 'c': cpu = atoi(optarg); break;
+    case 'B': batch = atoi(optarg); break;
+    case 'b': busy_poll = atoi(optarg); break;
+    case 's': spin = 1; break;
+    case 'v': verbose = 1; break;
+    default:  usage();
+    }
+  }
+  if (!keyfile || optind < argc || batch < 1 || batch > MAX_BATCH)
+    usage();
+
+  uint8_t k[16];
+  int err = keyfile_load(keyfile, k);
+  if (err) {
+    fprintf(stderr, "mac611d: %s: %s\n", keyfile, err == EINVAL? "must hold 16 bytes or 32 hex digits": strerror(err));
+    return 2;
+  }
+  MAC611_init(&ctx, k);
+  memset(k, 0, sizeof(k));
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (resolve(listen_on, NULL, &addr, &addr_len, 1) ||
+      (forward_to && resolve(forward_to, "localhost", &forward, &forward_len, 0)))
+    return 2;
+
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = ncpu > 0? ncpu: 1;
+  struct worker * w = aligned_alloc(64, threads*sizeof(*w));
+  if (!w)
+    return 1;
+  memset(w, 0, threads*sizeof(*w));
+
+  // All sockets are bound before the first packet, so that the
+  // kernel spreads the flows over all of them
+  for (int i=0; i<threads; i++) {
+    w[i].id = i;
+    w[i].cpu = cpu >= 0 && ncpu > 0? (cpu+i) % ncpu: -1;
+    w[i].fd = open_socket(&addr, addr_len, busy_poll);
+    if (w[i].fd < 0) {
+      perror("mac611d: socket");
+      return 1;
+    }
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  for (int i=0; i<threads; i++)
+    if (pthread_create(&w[i].thread, NULL, worker_run, &w[i])) {
+      perror("mac611d: pthread_create");
+      return 1;
+    }
+  fprintf(stderr, "mac611d: %s on %s, %d threads, batch %d\n", verify? "verifying": "signing", listen_on, threads, batch);
+
+  uint64_t last = 0;
+  while (!stop) {
+    sleep(1);
+    if (!verbose)
+      continue;
+    uint64_t rx = 0;
+    for (int i=0; i<threads; i++)
+      rx += __atomic_load_n(&w[i].rx, __ATOMIC_RELAXED);
+    fprintf(stderr, "mac611d: %llu packets/s\n", (unsigned long long)(rx-last));
+    last = rx;
+  }
+
+  uint64_t rx = 0, tx = 0, bad = 0, dropped = 0;
+  for (int i=0; i<threads; i++) {
+    pthread_join(w[i].thread, NULL);
+    close(w[i].fd);
+    rx += w[i].rx;
+    tx += w[i].tx;
+    bad += w[i].bad;
+    dropped += w[i].dropped;
+  }
+  fprintf(stderr, "mac611d: received %llu, sent %llu, bad tags %llu, dropped %llu\n",
+	  (unsigned long long)rx, (unsigned long long)tx, (unsigned long long)bad, (unsigned long long)dropped);
+  free(w);
+  return 0;
+}
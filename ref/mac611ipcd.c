@@ -0,0 +1,114 @@
+/************************************************************
+ * MAC611 tools
+ * mac611ipcd: key-holding tagging service (shared-memory rings)
+ * (c) 2018-2019 XXXX
+ *
+ * Clients use the tagipc.h library: they get shared rings and a
+ * payload region, and never see the key. One thread per client
+ * drains its submission ring in batches (see tagipc.c).
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "MAC611.h"
+#include "keyfile.h"
+#include "tagipc.h"
+
+static struct MAC611_context ctx;
+static int verbose = 0;
+static const char * path = "/tmp/mac611.sock";
+
+static void * client_run (void * arg) {
+  int sock = (int)(intptr_t)arg;
+  int err = tagipc_serve(&ctx, sock);
+  if (err)
+    fprintf(stderr, "mac611ipcd: client handshake: %s\n", strerror(err));
+  else if (verbose)
+    fprintf(stderr, "mac611ipcd: client disconnected\n");
+  close(sock);
+  return NULL;
+}
+
+static void on_signal (int sig) {
+  unlink(path);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static void usage (void) {
+  fprintf(stderr,
+	  "Usage: mac611ipcd -k keyfile [-s socket] [-v]\n"
+	  "  -k FILE    key: 16 raw bytes or 32 hex digits\n"
+	  "  -s PATH    Unix socket (default /tmp/mac611.sock)\n"
+	  "  -v         log the connections\n");
+  exit(2);
+}
+
+int main (int argc, char * argv[]) {
+  const char * keyfile = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "k:s:vh")) != -1) {
+    switch (c) {
+    case 'k': keyfile = optarg; break;
+    case 's': path = optarg; break;
+    case 'v': verbose = 1; break;
+    default:  usage();
+    }
+  }
+  if (!keyfile || optind < argc)
+    usage();
+
+  uint8_t k[16];
+  int err = keyfile_load(keyfile, k);
+  if (err) {
+    fprintf(stderr, "mac611ipcd: %s: %s\n", keyfile, err == EINVAL? "must hold 16 bytes or 32 hex digits": strerror(err));
+    return 2;
+  }
+  MAC611_init(&ctx, k);
+  memset(k, 0, sizeof(k));
+
+  // Clients of the same user only
+  umask(077);
+  int ls = tagipc_listen(path);
+  if (ls < 0) {
+    perror(path);
+    return 1;
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  if (verbose)
+    fprintf(stderr, "mac611ipcd: listening on %s\n", path);
+
+  for (;;) {
+    int s = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+    if (s < 0) {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+	continue;
+      perror("mac611ipcd: accept");
+      break;
+    }
+    pthread_t t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t, &attr, client_run, (void *)(intptr_t)s)) {
+      perror("mac611ipcd: pthread_create");
+      close(s);
+    }
+    pthread_attr_destroy(&attr);
+    if (verbose)
+      fprintf(stderr, "mac611ipcd: client connected\n");
+  }
+  unlink(path);
+  return 1;
+}
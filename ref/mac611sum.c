@@ -0,0 +1,357 @@
+/************************************************************
+ * MAC611 tools
+ * mac611sum: tag files and directory trees, check manifests
+ * (c) 2018-2019 XXXX
+ *
+ * Manifest lines are "<tag> <nonce>  <path>" (16 hex digits
+ * each). Every file gets a fresh random nonce, recorded in the
+ * manifest. Regular files are mapped with mmap, other inputs
+ * (pipes, "-" for stdin) are read into a ring of buffers. Files and
+ * directories are processed as tasks of a work-stealing pool.
+ *
+ * Large files are not split into ranges: MAC611_tag is one-shot
+ * over the whole message, so each file is tagged by one thread.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+#include "MAC611.h"
+#include "workpool.h"
+#include "tagstream.h"
+#include "keyfile.h"
+#include "toolutil.h"
+
+struct entry {
+  char * path;
+  uint8_t nonce[8];
+  uint8_t tag[8];
+  uint8_t expected[8]; // --check only
+  int ok;              // --check: 1 if expected verifies
+  uint64_t bytes;
+  int err;             // errno, 0 if tagged
+};
+
+static struct MAC611_context ctx;
+static struct workpool * pool;
+static int recursive = 0, checking = 0;
+
+// Results, appended by the workers
+static pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry ** entries = NULL;
+static size_t nentries = 0, capentries = 0;
+
+static void die (const char * msg) {
+  fprintf(stderr, "mac611sum: %s\n", msg);
+  exit(2);
+}
+
+static void add_entry (struct entry * e) {
+  pthread_mutex_lock(&entries_lock);
+  if (nentries == capentries) {
+    capentries = capentries? 2*capentries: 256;
+    entries = realloc(entries, capentries*sizeof(*entries));
+    if (!entries)
+      die("out of memory");
+  }
+  entries[nentries++] = e;
+  pthread_mutex_unlock(&entries_lock);
+}
+
+static struct entry * new_entry (const char * path) {
+  struct entry * e = calloc(1, sizeof(*e));
+  if (!e || !(e->path = strdup(path)))
+    die("out of memory");
+  return e;
+}
+
+static void hex (char * out, const uint8_t x[8]) {
+  for (int i=0; i<8; i++)
+    sprintf(out+2*i, "%02x", x[i]);
+}
+
+/*
+ * Tagging
+ */
+
+// Non-mappable input: reads overlapped with the hash (tagstream.c)
+static int tag_stream (int fd, struct entry * e) {
+  struct tagstream_options o = { 0, 0, TAGSTREAM_THREAD };
+  int err = tagstream_fd(&ctx, fd, &o, e->nonce, e->tag, &e->bytes);
+  e->ok = !err && MAC611_tag_equal(e->tag, e->expected);
+  return err;
+}
+
+static int tag_fd (int fd, struct entry * e) {
+  struct stat st;
+  if (fstat(fd, &st))
+    return errno;
+  if (!S_ISREG(st.st_mode) || st.st_size == 0)
+    return tag_stream(fd, e);
+
+  size_t len = st.st_size;
+  void * m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED)
+    return tag_stream(fd, e);
+  // Hints only: failures are harmless (e.g. no THP for this file system)
+  madvise(m, len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise(m, len, MADV_HUGEPAGE);
+#endif
+  if (checking)
+    e->ok = MAC611_verify(&ctx, m, len, e->nonce, e->expected);
+  else
+    MAC611_tag(&ctx, m, len, e->nonce, e->tag);
+  e->bytes = len;
+  munmap(m, len);
+  return 0;
+}
+
+static void tag_file (void * arg) {
+  struct entry * e = arg;
+  if (strcmp(e->path, "-") == 0) {
+    e->err = tag_stream(0, e);
+  } else {
+    int fd = open(e->path, O_RDONLY|O_NOCTTY);
+    if (fd < 0) {
+      e->err = errno;
+    } else {
+      e->err = tag_fd(fd, e);
+      close(fd);
+    }
+  }
+  add_entry(e);
+}
+
+static void submit_file (const char * path) {
+  struct entry * e = new_entry(path);
+  if (getrandom(e->nonce, 8, 0) != 8)
+    die("getrandom failed");
+  if (workpool_submit(pool, tag_file, e))
+    die("out of memory");
+}
+
+static void walk_dir (void * arg) {
+  char * path = arg;
+  DIR * d = opendir(path);
+  if (!d) {
+    struct entry * e = new_entry(path);
+    e->err = errno;
+    add_entry(e);
+    free(path);
+    return;
+  }
+  struct dirent * de;
+  while ((de = readdir(d))) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+      continue;
+    size_t n = strlen(path);
+    char * sub = malloc(n + strlen(de->d_name) + 2);
+    if (!sub)
+      die("out of memory");
+    sprintf(sub, "%s%s%s", path, n && path[n-1] == '/'? "": "/", de->d_name);
+
+    int type = de->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat st;
+      type = lstat(sub, &st)? DT_UNKNOWN: S_ISDIR(st.st_mode)? DT_DIR: S_ISREG(st.st_mode)? DT_REG: DT_UNKNOWN;
+    }
+    // Symbolic links and special files are skipped in trees
+    if (type == DT_DIR) {
+      if (workpool_submit(pool, walk_dir, sub))
+	die("out of memory");
+      continue;
+    }
+    if (type == DT_REG)
+      submit_file(sub);
+    free(sub);
+  }
+  closedir(d);
+  free(path);
+}
+
+static void submit_arg (const char * path) {
+  struct stat st;
+  if (strcmp(path, "-") && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    if (!recursive) {
+      struct entry * e = new_entry(path);
+      e->err = EISDIR;
+      add_entry(e);
+      return;
+    }
+    char * p = strdup(path);
+    if (!p || workpool_submit(pool, walk_dir, p))
+      die("out of memory");
+    return;
+  }
+  submit_file(path);
+}
+
+/*
+ * Manifest check
+ */
+
+static void submit_manifest (const char * manifest) {
+  FILE * f = strcmp(manifest, "-")? fopen(manifest, "r"): stdin;
+  if (!f) {
+    perror(manifest);
+    exit(2);
+  }
+  char * line = NULL;
+  size_t cap = 0;
+  ssize_t n;
+  unsigned lineno = 0;
+  while ((n = getline(&line, &cap, f)) > 0) {
+    lineno++;
+    if (line[n-1] == '\n')
+      line[--n] = 0;
+    if (n == 0)
+      continue;
+    uint8_t tag[8], nonce[8];
+    if (n < 36 || line[16] != ' ' || line[33] != ' ' || line[34] != ' ' ||
+	keyfile_unhex(tag, line, 8) || keyfile_unhex(nonce, line+17, 8)) {
+      fprintf(stderr, "mac611sum: %s:%u: improperly formatted line\n", manifest, lineno);
+      continue;
+    }
+    struct entry * e = new_entry(line+35);
+    memcpy(e->nonce, nonce, 8);
+    memcpy(e->expected, tag, 8);
+    if (workpool_submit(pool, tag_file, e))
+      die("out of memory");
+  }
+  free(line);
+  if (f != stdin)
+    fclose(f);
+}
+
+static int by_path (const void * a, const void * b) {
+  return strcmp((*(struct entry * const *)a)->path, (*(struct entry * const *)b)->path);
+}
+
+static void usage (void) {
+  fprintf(stderr,
+	  "Usage: mac611sum -k keyfile [options] [file|dir...]\n"
+	  "       mac611sum -k keyfile -c manifest\n"
+	  "Print \"<tag> <nonce>  <path>\" for each file (stdin if none or \"-\").\n"
+	  "  -k, --key FILE     16 raw bytes or 32 hex digits\n"
+	  "  -c, --check FILE   verify the tags of a manifest\n"
+	  "  -r, --recursive    tag the files of directory trees\n"
+	  "  -j, --threads N    worker threads (default: online CPUs)\n"
+	  "  -q, --quiet        --check: only print failures\n"
+	  "  -v, --verbose      report files, bytes and GB/s on stderr\n");
+  exit(2);
+}
+
+int main (int argc, char * argv[]) {
+  static const struct option longopts[] = {
+    { "key",       required_argument, NULL, 'k' },
+    { "check",     required_argument, NULL, 'c' },
+    { "recursive", no_argument,       NULL, 'r' },
+    { "threads",   required_argument, NULL, 'j' },
+    { "quiet",     no_argument,       NULL, 'q' },
+    { "verbose",   no_argument,       NULL, 'v' },
+    { "help",      no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  const char * keyfile = NULL;
+  const char * manifest = NULL;
+  int threads = 0, quiet = 0, verbose = 0, c;
+
+  while ((c = getopt_long(argc, argv, "k:c:rj:qvh", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'k': keyfile = optarg; break;
+    case 'c': manifest = optarg; break;
+    case 'r': recursive = 1; break;
+    case 'j': threads = atoi(optarg); break;
+    case 'q': quiet = 1; break;
+    case 'v': verbose = 1; break;
+    default:  usage();
+    }
+  }
+  if (!keyfile || (manifest && optind < argc))
+    usage();
+
+  uint8_t k[16];
+  int err = keyfile_load(keyfile, k);
+  if (err == EINVAL)
+    die("key file must hold 16 bytes or 32 hex digits");
+  if (err) {
+    fprintf(stderr, "mac611sum: %s: %s\n", keyfile, strerror(err));
+    return 2;
+  }
+  MAC611_init(&ctx, k);
+  memset(k, 0, sizeof(k));
+
+  pool = workpool_create(threads);
+  if (!pool)
+    die("cannot start the worker threads");
+
+  uint64_t t0 = now_ns();
+  if (manifest) {
+    checking = 1;
+    submit_manifest(manifest);
+  } else if (optind == argc) {
+    submit_arg("-");
+  } else {
+    for (int i=optind; i<argc; i++)
+      submit_arg(argv[i]);
+  }
+  workpool_wait(pool);
+  uint64_t t1 = now_ns();
+
+  // Sorted output, independent of the scheduling
+  qsort(entries, nentries, sizeof(*entries), by_path);
+  int status = 0;
+  unsigned failed = 0, unreadable = 0;
+  uint64_t bytes = 0;
+  for (size_t i=0; i<nentries; i++) {
+    struct entry * e = entries[i];
+    if (e->err) {
+      fprintf(stderr, "mac611sum: %s: %s\n", e->path, strerror(e->err));
+      unreadable++;
+      status = 1;
+    } else if (checking) {
+      int ok = e->ok;
+      if (!ok) {
+	failed++;
+	status = 1;
+      }
+      if (!ok || !quiet)
+	printf("%s: %s\n", e->path, ok? "OK": "FAILED");
+    } else {
+      char t[17], n[17];
+      hex(t, e->tag);
+      hex(n, e->nonce);
+      printf("%s %s  %s\n", t, n, e->path);
+    }
+    bytes += e->bytes;
+    free(e->path);
+    free(e);
+  }
+  if (checking && failed)
+    fprintf(stderr, "mac611sum: WARNING: %u computed tag%s did NOT match\n", failed, failed > 1? "s": "");
+  if (checking && unreadable)
+    fprintf(stderr, "mac611sum: WARNING: %u listed file%s could not be read\n", unreadable, unreadable > 1? "s": "");
+  if (verbose) {
+    double s = (t1-t0)*1e-9;
+    fprintf(stderr, "mac611sum: %zu files, %llu bytes, %d threads, %.3f s, %.3f GB/s\n",
+	    nentries, (unsigned long long)bytes, workpool_size(pool), s, s > 0? bytes/s*1e-9: 0);
+  }
+
+  free(entries);
+  workpool_destroy(pool);
+  return status;
+}
@@ -0,0 +1,96 @@
+/************************************************************
+ * MAC611 reference implementation
+ * Multiplication mod 2^61-1
+ * (c) 2018-2019 XXXX
+ *
+ * Inline functions, shared by MAC611.c and the C++ headers.
+ * MUL611_IMPLEM names the version selected with compiler macros.
+ * Define MUL611_GENERIC to use the generic C version even when
+ * 128-bit integers are available.
+ ************************************************************/
+
+#ifndef MUL611_H
+#define MUL611_H
+
+#include "MAC611.h"
+
+static inline uint64_t REDUCE_611(uint64_t x) {
+  return x%(0x1fffffffffffffffULL);
+}
+
+#if defined(__SIZEOF_INT128__) && !defined(MUL611_GENERIC)
+
+/*** GCC version with 128-bit integer ***/
+#define MUL611_IMPLEM "GCC int128"
+static inline uint64_t mul611(uint64_t x, uint64_t y) {
+  unsigned __int128 z = (unsigned __int128) x*y;
+  return z%MOD611;
+}
+
+#else  //__SIZEOF_INT128__
+
+/*** Generic C version ***/
+#define MUL32(a,b) ((uint64_t)(a)*(b))
+
+#define MUL611_IMPLEM "Generic C"
+static inline uint64_t mul611(uint64_t x, uint64_t y) {
+  // Split input
+  uint32_t xl = x;
+  uint32_t xh = x>>32;
+  uint32_t yl = y;
+  uint32_t yh = y>>32;
+
+  // 128-bit intermediate value
+  uint32_t m0 = 0;
+  uint32_t m1 = 0;
+  uint32_t m2 = 0;
+  uint32_t m3 = 0;
+
+  uint64_t t;
+  uint32_t th, tl;
+
+  t = MUL32(xl, yl);
+  tl = t;
+  th = t>>32;
+  m0 = tl;
+  m1 = th;
+
+  t = MUL32(xh, yh);
+  tl = t;
+  th = t>>32;
+  m2 = tl;
+  m3 = th;
+
+  t  = MUL32(xh, yl);
+  t += MUL32(xl, yh);
+  
+  tl = t;
+  th = t>>32;
+  m1 += tl;
+  th += (m1 < tl);
+  m2 += th;
+  m3 += (m2 < th);
+  
+
+  // Reduce mod 2^61-1
+  uint32_t r0;
+  uint32_t r1;
+  uint32_t rr;
+  
+  r1  = m1&(0xffffffff>>3);
+
+  r0 = m0;
+  rr = r0 + (m1>>29);
+  r1 += (rr < r0); // Carry!
+  r0  = rr + (m2<<3);
+  r1 += (r0 < rr); // Carry!
+
+  r1 += m2>>29;
+  r1 += m3<<3;
+
+  return ((uint64_t)r1<<32) + r0;
+}
+
+#endif //__SIZEOF_INT128__
+
+#endif // MUL611_H
@@ -0,0 +1,315 @@
+/************************************************************
+ * MAC611 tools
+ * Nonce allocator for concurrent senders
+ * (c) 2018-2019 XXXX
+ *
+ * The shared counter, the persisted mark and the rest of the
+ * allocator are on separate cache lines: reservations write the
+ * counter line only, and read the mark line that changes once
+ * every ahead/2 nonces.
+ *
+ * The cursors are in thread-local slots indexed by the serial
+ * number of the allocator (unique in the process): with more
+ * allocators than slots in use by one thread, a collision drops
+ * the rest of a block, which is never handed out.
+ *
+ * State file: "MAC611NP" and the mark (8 bytes, little endian),
+ * replaced atomically (temporary file, fdatasync, rename).
+ * The rename replaces its inode, so the exclusive lock is on a
+ * separate file, path.lock, opened and locked (flock) by
+ * noncepool_open and closed by noncepool_close. It is left in
+ * place: removing it would race with another open.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+
+#include "noncepool.h"
+#include "toolutil.h"
+
+#define CACHE_LINE 64
+#define SLOTS      4
+#define MAGIC      "MAC611NP"
+#define LIMIT      (1ULL << 63) // Counter values above: EOVERFLOW (no wrap around)
+
+struct noncepool {
+  // Read-only after noncepool_open
+  const struct MAC611_context * ctx;
+  uint64_t serial, block, ahead;
+  char * path;               // NULL: no persistence
+  int lock_fd;               // path.lock, locked until noncepool_close
+
+  // Reservations
+  uint64_t counter __attribute__((aligned(CACHE_LINE)));
+  // Persisted high-water mark (UINT64_MAX without persistence)
+  uint64_t mark __attribute__((aligned(CACHE_LINE)));
+
+  // Persister
+  int requested __attribute__((aligned(CACHE_LINE)));
+  int stop, err;             // err: last persistence failure
+  pthread_t persister;
+  pthread_mutex_t lock;
+  pthread_cond_t work;       // To the persister: mark requested, stop
+  pthread_cond_t moved;      // To the waiting reservations
+};
+
+struct cursor {
+  uint64_t serial;           // Allocator of the cursor (0: none)
+  uint64_t next, end;
+};
+
+static __thread struct cursor cursors[SLOTS];
+static uint64_t serials = 0;
+
+static int read_mark (const char * path, uint64_t * mark) {
+  int fd = open(path, O_RDONLY|O_CLOEXEC);
+  if (fd < 0 && errno == ENOENT) {
+    *mark = 0;
+    return 0;
+  }
+  if (fd < 0)
+    return errno;
+  uint8_t b[17];
+  ssize_t n = read(fd, b, sizeof(b));
+  int err = n < 0? errno: 0;
+  close(fd);
+  if (err)
+    return err;
+  if (n == 0) {
+    *mark = 0;
+    return 0;
+  }
+  if (n != 16 || memcmp(b, MAGIC, 8))
+    return EINVAL;
+  *mark = read64(b+8);
+  return 0;
+}
+
+// Exclusive lock of the state file: EWOULDBLOCK if held by another allocator
+static int lock_state (const char * path, int * fd) {
+  size_t n = strlen(path);
+  char * lock = malloc(n + 6);
+  if (!lock)
+    return ENOMEM;
+  sprintf(lock, "%s.lock", path);
+  int err = 0;
+  *fd = open(lock, O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+  if (*fd < 0 || flock(*fd, LOCK_EX|LOCK_NB))
+    err = errno;
+  if (err && *fd >= 0)
+    close(*fd);
+  if (err)
+    *fd = -1;
+  free(lock);
+  return err;
+}
+
+static int write_mark (const char * path, uint64_t mark) {
+  size_t n = strlen(path);
+  char * tmp = malloc(n + 5);
+  char * dir = malloc(n + 2);
+  if (!tmp || !dir) {
+    free(tmp);
+    free(dir);
+    return ENOMEM;
+  }
+  sprintf(tmp, "%s.tmp", path);
+  strcpy(dir, path);
+  char * slash = strrchr(dir, '/');
+  if (!slash)
+    strcpy(dir, ".");
+  else if (slash == dir)
+    dir[1] = 0;
+  else
+    *slash = 0;
+
+  uint8_t b[16];
+  memcpy(b, MAGIC, 8);
+  put64(b+8, mark);
+  int err = 0;
+  errno = 0;
+  int fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600);
+  if (fd < 0 || write(fd, b, sizeof(b)) != sizeof(b) || fdatasync(fd))
+    err = errno? errno: EIO;
+  if (fd >= 0)
+    close(fd);
+  if (!err && rename(tmp, path))
+    err = errno;
+  // The rename itself must reach the disk
+  int dfd = err? -1: open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (!err && (dfd < 0 || fsync(dfd)))
+    err = errno;
+  if (dfd >= 0)
+    close(dfd);
+  if (err)
+    unlink(tmp);
+  free(tmp);
+  free(dir);
+  return err;
+}
+
+static void * persist_run (void * arg) {
+  struct noncepool * p = arg;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->stop && !__atomic_load_n(&p->requested, __ATOMIC_ACQUIRE))
+      pthread_cond_wait(&p->work, &p->lock);
+    if (p->stop)
+      break;
+    __atomic_store_n(&p->requested, 0, __ATOMIC_RELAXED);
+    uint64_t target = __atomic_load_n(&p->counter, __ATOMIC_RELAXED) + p->ahead;
+    uint64_t mark = p->mark;
+    pthread_mutex_unlock(&p->lock);
+
+    int err = target > mark? write_mark(p->path, target): 0;
+
+    pthread_mutex_lock(&p->lock);
+    p->err = err;
+    if (!err && target > mark)
+      __atomic_store_n(&p->mark, target, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&p->moved);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static void request (struct noncepool * p) {
+  if (!__atomic_exchange_n(&p->requested, 1, __ATOMIC_RELEASE)) {
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+static int reserve (struct noncepool * p, struct cursor * c) {
+  uint64_t begin = __atomic_fetch_add(&p->counter, p->block, __ATOMIC_RELAXED);
+  if (begin >= LIMIT)
+    return EOVERFLOW;
+  uint64_t end = begin + p->block;
+
+  if (p->path) {
+    uint64_t mark = __atomic_load_n(&p->mark, __ATOMIC_ACQUIRE);
+    if (end + p->ahead/2 > mark)
+      request(p);
+    if (end > mark) {
+      // The persister is behind: wait for the mark
+      int err = 0;
+      pthread_mutex_lock(&p->lock);
+      while (p->mark < end && !(err = p->err)) {
+	__atomic_store_n(&p->requested, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&p->work);
+	pthread_cond_wait(&p->moved, &p->lock);
+      }
+      pthread_mutex_unlock(&p->lock);
+      if (err)
+	return err;
+    }
+  }
+
+  c->serial = p->serial;
+  c->next = begin;
+  c->end = end;
+  return 0;
+}
+
+struct noncepool * noncepool_open (const char * path, const struct MAC611_context * ctx, const struct noncepool_options * o) {
+  struct noncepool * p = aligned_alloc(CACHE_LINE, sizeof(*p));
+  if (!p) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  memset(p, 0, sizeof(*p));
+  p->ctx = ctx;
+  p->serial = __atomic_add_fetch(&serials, 1, __ATOMIC_RELAXED);
+  p->block = o && o->block? o->block: 4096;
+  p->ahead = o && o->ahead? o->ahead: 1<<24;
+  if (p->block > LIMIT/4)
+    p->block = LIMIT/4;
+  if (p->ahead < 2*p->block)
+    p->ahead = 2*p->block;
+  if (p->ahead > LIMIT/2)
+    p->ahead = LIMIT/2;
+  p->mark = UINT64_MAX;
+  p->lock_fd = -1;
+
+  if (path) {
+    uint64_t mark = 0;
+    // The mark is read once: no other allocator may move it
+    int err = lock_state(path, &p->lock_fd);
+    if (!err)
+      err = read_mark(path, &mark);
+    if (!err && mark >= LIMIT)
+      err = EOVERFLOW;
+    if (!err && !(p->path = strdup(path)))
+      err = ENOMEM;
+    // Nothing is handed out before a mark is on disk
+    if (!err && !(err = write_mark(path, mark + p->ahead))) {
+      p->counter = mark;
+      p->mark = mark + p->ahead;
+      pthread_mutex_init(&p->lock, NULL);
+      pthread_cond_init(&p->work, NULL);
+      pthread_cond_init(&p->moved, NULL);
+      err = pthread_create(&p->persister, NULL, persist_run, p);
+    }
+    if (err) {
+      if (p->lock_fd >= 0)
+	close(p->lock_fd);
+      free(p->path);
+      free(p);
+      errno = err;
+      return NULL;
+    }
+  }
+  return p;
+}
+
+void noncepool_close (struct noncepool * p) {
+  if (p->path) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->persister, NULL);
+    // Every nonce handed out is below the counter
+    write_mark(p->path, p->counter);
+    close(p->lock_fd);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->moved);
+    free(p->path);
+  }
+  free(p);
+}
+
+int noncepool_next (struct noncepool * p, uint8_t nonce[8]) {
+  struct cursor * c = &cursors[p->serial % SLOTS];
+  if (c->serial != p->serial || c->next == c->end) {
+    int err = reserve(p, c);
+    if (err)
+      return err;
+  }
+  put64(nonce, c->next++);
+  return 0;
+}
+
+int noncepool_tag (struct noncepool * p, const uint8_t * m, size_t len, uint8_t nonce[8], uint8_t tag[8]) {
+  int err = noncepool_next(p, nonce);
+  if (!err)
+    MAC611_tag(p->ctx, m, len, nonce, tag);
+  return err;
+}
+
+uint64_t noncepool_counter (const struct noncepool * p) {
+  return __atomic_load_n(&p->counter, __ATOMIC_RELAXED);
+}
+
+uint64_t noncepool_mark (const struct noncepool * p) {
+  return __atomic_load_n(&p->mark, __ATOMIC_ACQUIRE);
+}
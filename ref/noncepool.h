@@ -0,0 +1,60 @@
+/************************************************************
+ * MAC611 tools
+ * Nonce allocator for concurrent senders
+ * (c) 2018-2019 XXXX
+ *
+ * Nonces are the values of a 64-bit counter (8 bytes, little
+ * endian). Each thread reserves a block of nonces with one atomic
+ * fetch-add on the shared counter, then takes them one by one
+ * from its own cursor (thread-local, no shared write).
+ *
+ * With a state file, a high-water mark is persisted ahead of the
+ * counter: after a crash, the allocator starts again from the
+ * mark, above any nonce handed out. The mark is moved by a
+ * background thread when the counter gets within half of ahead
+ * from it; threads only wait for it when the counter has caught
+ * up with the mark.
+ ************************************************************/
+
+#ifndef NONCEPOOL_H
+#define NONCEPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct noncepool_options {
+  uint64_t block;  // Nonces per reservation of a thread (0: 4096)
+  uint64_t ahead;  // Nonces covered by the mark beyond the counter (0: 2^24)
+};
+
+struct noncepool;
+
+// Allocator for the context ctx. path: state file (created if
+// needed, an empty file is a new allocator), NULL for no
+// persistence (from 0). NULL on failure (errno set): EWOULDBLOCK
+// while another allocator, in this process or another one, holds
+// the state file (lock on path.lock until noncepool_close).
+struct noncepool * noncepool_open (const char * path, const struct MAC611_context * ctx, const struct noncepool_options * o);
+// Persists the counter as the mark, no call must be running
+void noncepool_close (struct noncepool * p);
+
+// Next nonce: 0, EOVERFLOW (counter exhausted) or the errno value
+// of a failed persistence of the mark
+int noncepool_next (struct noncepool * p, uint8_t nonce[8]);
+// Tag of m with the next nonce (written in nonce)
+int noncepool_tag (struct noncepool * p, const uint8_t * m, size_t len, uint8_t nonce[8], uint8_t tag[8]);
+
+// Start of the next reservation, and the persisted mark
+uint64_t noncepool_counter (const struct noncepool * p);
+uint64_t noncepool_mark (const struct noncepool * p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NONCEPOOL_H
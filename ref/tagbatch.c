@@ -0,0 +1,154 @@
+/************************************************************
+ * MAC611 tools
+ * Batch verification engine
+ * (c) 2018-2019 XXXX
+ *
+ * Tasks can share a word of the bitmap: each task sets its bits
+ * in a local bitmap, merged with atomic ORs when it is done. The
+ * short messages of a task are verified in order of length, so
+ * that mixed lengths still give MAC611_tag_x4 groups of similar
+ * messages.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tagbatch.h"
+#include "workpool.h"
+
+struct tagbatch {
+  const struct MAC611_context * ctx;
+  struct workpool * pool;      // NULL: one thread
+  struct task * tasks;
+  size_t cap;
+};
+
+struct task {
+  struct tagbatch * b;
+  const struct tagbatch_item * items;
+  size_t begin, end;
+  uint64_t * pass;
+  size_t * passed;
+};
+
+struct tagbatch * tagbatch_create (const struct MAC611_context * ctx, int threads) {
+  struct tagbatch * b = calloc(1, sizeof(*b));
+  if (!b)
+    return NULL;
+  b->ctx = ctx;
+  if (threads != 1 && !(b->pool = workpool_create(threads))) {
+    free(b);
+    return NULL;
+  }
+  return b;
+}
+
+void tagbatch_destroy (struct tagbatch * b) {
+  if (b->pool)
+    workpool_destroy(b->pool);
+  free(b->tasks);
+  free(b);
+}
+
+static int by_len (const void * a, const void * b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Items begin..end (at most TAGBATCH_TASK_ITEMS), their bits in a
+// local bitmap merged at the end
+static void slice_run (struct task * t, size_t begin, size_t end) {
+  const struct MAC611_context * ctx = t->b->ctx;
+  uint64_t v[TAGBATCH_TASK_ITEMS/64 + 1] = { 0 };
+  size_t base = begin/64, passed = 0;
+#define SET(i, ok) (v[(i)/64 - base] |= (uint64_t)(ok) << ((i)%64), passed += (ok))
+
+  // Short messages: length << 32 | item, sorted by length so that the
+  // groups of MAC611_tag_x4 share most of their blocks
+  uint64_t shorts[TAGBATCH_TASK_ITEMS];
+  size_t ns = 0;
+  int sorted = 1;
+  for (size_t i = begin; i < end; i++) {
+    const struct tagbatch_item * it = &t->items[i];
+    if (it->len > TAGBATCH_SHORT) {
+      SET(i, MAC611_verify(ctx, it->m, it->len, it->nonce, it->tag));
+      continue;
+    }
+    shorts[ns] = (uint64_t)it->len << 32 | (i - begin);
+    sorted &= !ns || shorts[ns-1] <= shorts[ns];
+    ns++;
+  }
+  if (!sorted)
+    qsort(shorts, ns, sizeof(*shorts), by_len);
+
+  size_t g = 0;
+  for (; g+4 <= ns; g += 4) {
+    const uint8_t * m[4], * nonce[4];
+    size_t len[4], idx[4];
+    uint8_t tags[4][8];
+    uint8_t * out[4] = { tags[0], tags[1], tags[2], tags[3] };
+    for (int j=0; j<4; j++) {
+      idx[j] = begin + (uint32_t)shorts[g+j];
+      m[j] = t->items[idx[j]].m;
+      len[j] = t->items[idx[j]].len;
+      nonce[j] = t->items[idx[j]].nonce;
+    }
+    MAC611_tag_x4(ctx, m, len, nonce, out);
+    for (int j=0; j<4; j++)
+      SET(idx[j], MAC611_tag_equal(tags[j], t->items[idx[j]].tag));
+  }
+  for (; g < ns; g++) {
+    size_t i = begin + (uint32_t)shorts[g];
+    const struct tagbatch_item * it = &t->items[i];
+    SET(i, MAC611_verify(ctx, it->m, it->len, it->nonce, it->tag));
+  }
+#undef SET
+
+  for (size_t w = base; w <= (end-1)/64; w++)
+    if (v[w - base])
+      __atomic_fetch_or(&t->pass[w], v[w - base], __ATOMIC_RELAXED);
+  __atomic_fetch_add(t->passed, passed, __ATOMIC_RELAXED);
+}
+
+static void task_run (void * arg) {
+  struct task * t = arg;
+  // Longer than TAGBATCH_TASK_ITEMS: the rest of a batch, out of memory
+  for (size_t i = t->begin; i < t->end; i += TAGBATCH_TASK_ITEMS)
+    slice_run(t, i, t->end - i < TAGBATCH_TASK_ITEMS? t->end: i + TAGBATCH_TASK_ITEMS);
+}
+
+size_t tagbatch_verify (struct tagbatch * b, const struct tagbatch_item * items, size_t n, uint64_t * pass) {
+  memset(pass, 0, (n+63)/64*sizeof(uint64_t));
+  size_t passed = 0, ntasks = 0;
+
+  for (size_t i=0; i<n; ) {
+    // Next task: up to TAGBATCH_TASK_BYTES or TAGBATCH_TASK_ITEMS
+    size_t begin = i, bytes = 0;
+    for (; i<n && bytes < TAGBATCH_TASK_BYTES && i-begin < TAGBATCH_TASK_ITEMS; i++)
+      bytes += items[i].len + 64; // Finalization: about 64 bytes of hashing
+    if (ntasks == b->cap) {
+      size_t cap = b->cap? 2*b->cap: 64;
+      struct task * tasks = realloc(b->tasks, cap*sizeof(*tasks));
+      if (!tasks) {
+	// Out of memory: the rest here
+	struct task t = { b, items, begin, n, pass, &passed };
+	task_run(&t);
+	break;
+      }
+      b->tasks = tasks;
+      b->cap = cap;
+    }
+    b->tasks[ntasks++] = (struct task){ b, items, begin, i, pass, &passed };
+  }
+
+  if (!b->pool || ntasks == 1) {
+    for (size_t k=0; k<ntasks; k++)
+      task_run(&b->tasks[k]);
+    return passed;
+  }
+  for (size_t k=0; k<ntasks; k++)
+    if (workpool_submit(b->pool, task_run, &b->tasks[k]))
+      task_run(&b->tasks[k]);
+  workpool_wait(b->pool);
+  return passed;
+}
@@ -0,0 +1,51 @@
+/************************************************************
+ * MAC611 tools
+ * Batch verification engine
+ * (c) 2018-2019 XXXX
+ *
+ * A batch of (message, nonce, tag) is cut into tasks of about
+ * TAGBATCH_TASK_BYTES for a work-stealing pool (a batch smaller
+ * than one task is verified by the calling thread). Within a task,
+ * short messages are verified four at a time with MAC611_tag_x4
+ * (grouped by length), longer ones with MAC611_verify; tags are
+ * compared in constant time.
+ ************************************************************/
+
+#ifndef TAGBATCH_H
+#define TAGBATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAGBATCH_TASK_BYTES (64<<10)
+#define TAGBATCH_TASK_ITEMS 512
+#define TAGBATCH_SHORT      (7*LAMBDA) // Longest message for MAC611_tag_x4
+
+struct tagbatch_item {
+  const uint8_t * m;
+  size_t len;
+  const uint8_t * nonce; // 8 bytes
+  const uint8_t * tag;   // 8 bytes
+};
+
+struct tagbatch;
+
+// threads <= 0: one per online CPU, 1: no pool. NULL on failure.
+struct tagbatch * tagbatch_create (const struct MAC611_context * ctx, int threads);
+void tagbatch_destroy (struct tagbatch * b);
+
+// Sets bit i of pass ((n+63)/64 words) if items[i] verifies, clears
+// it otherwise. Returns the number of items that verify. Calls on
+// one engine must not overlap.
+size_t tagbatch_verify (struct tagbatch * b, const struct tagbatch_item * items, size_t n, uint64_t * pass);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAGBATCH_H
@@ -0,0 +1,175 @@
+/************************************************************
+ * MAC611 tools
+ * Chunked objects: verification of byte ranges
+ * (c) 2018-2019 XXXX
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tagchunk.h"
+#include "workpool.h"
+#include "toolutil.h"
+
+#define MAGIC "MAC611CM"
+#define TASK_BYTES (1<<20) // Chunks per task of the parallel build: at least 1 MiB
+#define MANIFEST_NONCE (1ULL << 63)
+
+static uint64_t chunk_len (const struct tagchunk_manifest * m, uint64_t i) {
+  uint64_t off = i * m->chunk_size;
+  return m->size - off < m->chunk_size? m->size - off: m->chunk_size;
+}
+
+static void chunk_nonce (const struct tagchunk_manifest * m, uint64_t i, uint8_t nonce[8]) {
+  put64(nonce, m->id << 32 | i);
+}
+
+static void manifest_nonce (const struct tagchunk_manifest * m, uint8_t nonce[8]) {
+  put64(nonce, MANIFEST_NONCE | m->id << 32);
+}
+
+static void chunk_tag (const struct MAC611_context * ctx, const struct tagchunk_manifest * m,
+		       uint64_t i, const uint8_t * data, uint8_t tag[8]) {
+  uint8_t nonce[8];
+  chunk_nonce(m, i, nonce);
+  MAC611_tag(ctx, data, chunk_len(m, i), nonce, tag);
+}
+
+static void manifest_tag (const struct MAC611_context * ctx, const struct tagchunk_manifest * m, uint8_t tag[8]) {
+  uint8_t nonce[8];
+  manifest_nonce(m, nonce);
+  MAC611_tag(ctx, m->bytes, m->len - 8, nonce, tag);
+}
+
+// Checks the parameters of a manifest: its chunks and length in bytes
+static int manifest_geometry (uint64_t id, uint64_t size, uint32_t chunk_size, uint64_t * chunks, uint64_t * len) {
+  if (id >> 31 || !chunk_size || chunk_size % 7)
+    return EINVAL;
+  *chunks = size / chunk_size + (size % chunk_size != 0);
+  if (*chunks > 1ULL << 32)
+    return EINVAL;
+  *len = TAGCHUNK_HEADER + 8 * *chunks + 8;
+  return 0;
+}
+
+static int manifest_alloc (struct tagchunk_manifest * m, uint64_t id, uint64_t size, uint32_t chunk_size) {
+  uint64_t chunks, len;
+  int err = manifest_geometry(id, size, chunk_size, &chunks, &len);
+  if (err)
+    return err;
+  m->id = id;
+  m->size = size;
+  m->chunks = chunks;
+  m->chunk_size = chunk_size;
+  m->len = len;
+  if (!(m->bytes = malloc(m->len)))
+    return ENOMEM;
+  return 0;
+}
+
+struct build_task {
+  const struct MAC611_context * ctx;
+  const struct tagchunk_manifest * m;
+  const uint8_t * object;
+  uint64_t begin, end;
+};
+
+static void build_run (void * arg) {
+  struct build_task * t = arg;
+  for (uint64_t i = t->begin; i < t->end; i++)
+    chunk_tag(t->ctx, t->m, i, t->object + i * t->m->chunk_size, t->m->bytes + TAGCHUNK_HEADER + 8*i);
+}
+
+int tagchunk_build (const struct MAC611_context * ctx, uint64_t id, const uint8_t * object, uint64_t size,
+		    uint32_t chunk_size, int threads, struct tagchunk_manifest * m) {
+  int err = manifest_alloc(m, id, size, chunk_size);
+  if (err)
+    return err;
+  memcpy(m->bytes, MAGIC, 8);
+  put64(m->bytes+8, id);
+  put64(m->bytes+16, size);
+  put32(m->bytes+24, chunk_size);
+  put32(m->bytes+28, 0);
+
+  uint64_t per_task = (TASK_BYTES + chunk_size-1) / chunk_size;
+  uint64_t ntasks = (m->chunks + per_task-1) / per_task;
+  struct build_task * tasks = calloc(ntasks? ntasks: 1, sizeof(*tasks));
+  struct workpool * pool = tasks && threads != 1 && ntasks > 1? workpool_create(threads): NULL;
+  if (!tasks) {
+    tagchunk_free(m);
+    return ENOMEM;
+  }
+  for (uint64_t k=0; k<ntasks; k++) {
+    uint64_t end = (k+1)*per_task;
+    tasks[k] = (struct build_task){ ctx, m, object, k*per_task, end < m->chunks? end: m->chunks };
+    // Without a pool (one thread, one task or no memory): here
+    if (!pool || workpool_submit(pool, build_run, &tasks[k]))
+      build_run(&tasks[k]);
+  }
+  if (pool) {
+    workpool_wait(pool);
+    workpool_destroy(pool);
+  }
+  free(tasks);
+
+  manifest_tag(ctx, m, m->bytes + m->len - 8);
+  return 0;
+}
+
+int tagchunk_load (const struct MAC611_context * ctx, const uint8_t * bytes, size_t len, struct tagchunk_manifest * m) {
+  if (len < TAGCHUNK_HEADER+8 || memcmp(bytes, MAGIC, 8) || get32(bytes+28))
+    return EINVAL;
+  // The header is not authenticated yet: nothing is allocated
+  // for it before it matches the length of the manifest
+  uint64_t id = read64(bytes+8), size = read64(bytes+16), chunks, expected;
+  uint32_t chunk_size = get32(bytes+24);
+  int err = manifest_geometry(id, size, chunk_size, &chunks, &expected);
+  if (err)
+    return err;
+  if (expected != len)
+    return EINVAL;
+  if ((err = manifest_alloc(m, id, size, chunk_size)))
+    return err;
+  memcpy(m->bytes, bytes, len);
+  uint8_t nonce[8];
+  manifest_nonce(m, nonce);
+  if (!MAC611_verify(ctx, m->bytes, len - 8, nonce, m->bytes + len - 8)) {
+    tagchunk_free(m);
+    return EBADMSG;
+  }
+  return 0;
+}
+
+void tagchunk_free (struct tagchunk_manifest * m) {
+  free(m->bytes);
+  m->bytes = NULL;
+  m->len = 0;
+}
+
+void tagchunk_span (const struct tagchunk_manifest * m, uint64_t offset, uint64_t len, uint64_t * first, uint64_t * n) {
+  *first = offset / m->chunk_size;
+  *n = len? (offset + len - 1) / m->chunk_size - *first + 1: 0;
+}
+
+int tagchunk_verify_chunks (const struct MAC611_context * ctx, const struct tagchunk_manifest * m,
+			    uint64_t first, uint64_t n, const uint8_t * data) {
+  if (first > m->chunks || n > m->chunks - first)
+    return EINVAL;
+  int bad = 0;
+  for (uint64_t i = first; i < first+n; i++) {
+    uint8_t nonce[8];
+    chunk_nonce(m, i, nonce);
+    bad |= !MAC611_verify(ctx, data + (i-first) * m->chunk_size, chunk_len(m, i), nonce, m->bytes + TAGCHUNK_HEADER + 8*i);
+  }
+  return bad? EBADMSG: 0;
+}
+
+int tagchunk_verify_range (const struct MAC611_context * ctx, const struct tagchunk_manifest * m,
+			   const uint8_t * object, uint64_t offset, uint64_t len) {
+  if (offset > m->size || len > m->size - offset)
+    return EINVAL;
+  uint64_t first, n;
+  tagchunk_span(m, offset, len, &first, &n);
+  return tagchunk_verify_chunks(ctx, m, first, n, object + first * m->chunk_size);
+}
@@ -0,0 +1,69 @@
+/************************************************************
+ * MAC611 tools
+ * Chunked objects: verification of byte ranges
+ * (c) 2018-2019 XXXX
+ *
+ * An object is split in chunks of chunk_size bytes (a multiple of
+ * 7: chunks start on a block boundary), the last one possibly
+ * shorter. Each chunk is tagged on its own, and the chunk tags
+ * make a manifest, tagged as well. A byte range is then verified
+ * with the chunks it covers only, once the manifest is loaded.
+ *
+ * Nonces: chunk i of object id is (id << 32) | i, the manifest of
+ * object id is 2^63 | (id << 32). Object ids below 2^31, at most
+ * 2^32 chunks per object, and an object id is never used twice
+ * with the same key (objects change: new id).
+ *
+ * Manifest, all little endian:
+ * "MAC611CM" | id (8) | size (8) | chunk_size (4) | 0 (4) |
+ * chunk tags (8 each) | tag of all that (8)
+ ************************************************************/
+
+#ifndef TAGCHUNK_H
+#define TAGCHUNK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAGCHUNK_HEADER 32
+#define TAGCHUNK_DEFAULT_SIZE (7*1024*9) // 64512 bytes: 9 rekey periods
+
+struct tagchunk_manifest {
+  uint64_t id;
+  uint64_t size;        // Object bytes
+  uint64_t chunks;
+  uint32_t chunk_size;
+  uint8_t * bytes;      // Serialized manifest
+  size_t len;
+};
+
+// Tags the chunks of object with threads threads (<= 0: online CPUs)
+// and builds the manifest. 0, EINVAL (id, chunk_size) or ENOMEM.
+int  tagchunk_build (const struct MAC611_context * ctx, uint64_t id, const uint8_t * object, uint64_t size,
+		     uint32_t chunk_size, int threads, struct tagchunk_manifest * m);
+// Copies and checks a serialized manifest: 0, EINVAL (malformed),
+// EBADMSG (wrong tag) or ENOMEM
+int  tagchunk_load (const struct MAC611_context * ctx, const uint8_t * bytes, size_t len, struct tagchunk_manifest * m);
+void tagchunk_free (struct tagchunk_manifest * m);
+
+// Chunks [*first, *first + *n) cover bytes [offset, offset+len),
+// they start at byte *first * chunk_size of the object
+void tagchunk_span (const struct tagchunk_manifest * m, uint64_t offset, uint64_t len, uint64_t * first, uint64_t * n);
+// Checks chunks [first, first+n), data holding them (read from the
+// object at first * chunk_size): 0, EINVAL (beyond the object) or EBADMSG
+int  tagchunk_verify_chunks (const struct MAC611_context * ctx, const struct tagchunk_manifest * m,
+			     uint64_t first, uint64_t n, const uint8_t * data);
+// Same for a byte range, with the whole object in memory (e.g. mmap)
+int  tagchunk_verify_range (const struct MAC611_context * ctx, const struct tagchunk_manifest * m,
+			    const uint8_t * object, uint64_t offset, uint64_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAGCHUNK_H
@@ -0,0 +1,473 @@
+/************************************************************
+ * MAC611 tools
+ * Shared-memory tagging service: the key stays in the service
+ * (c) 2018-2019 XXXX
+ *
+ * Segment layout: a header page with the ring indices (one cache
+ * line per index or flag, each written by one side only), the
+ * submission ring, the completion ring, then the payload region.
+ * The service keeps its own copy of the layout and only reads the
+ * indices and descriptors from the segment: descriptors are
+ * copied, then checked against the payload region. The memfd is
+ * sealed at its size before it is passed to the client, so that the
+ * client cannot truncate the mapping of the service.
+ *
+ * Sleeping (TAGIPC_EVENTFD): the consumer sets its idle flag, then
+ * checks the ring again before blocking; the producer publishes,
+ * then reads the flag. With a full fence on both sides, at least
+ * one of them sees the other, so that no wakeup is lost.
+ * Spinning (TAGIPC_POLL) yields the CPU every SPIN_YIELD rounds,
+ * so that a client and the service can share one CPU.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "tagipc.h"
+
+#define MAGIC       0x3136434d // "MC61"
+#define VERSION     1
+#define MAX_ENTRIES 65536
+#define MAX_PAYLOAD (1ULL<<32)
+#define BATCH       64   // Tags computed before the completions are published
+#define SPIN_YIELD  1024
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
+
+#define LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define FENCE()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+struct desc {
+  uint64_t id;
+  uint64_t off;  // In the payload region
+  uint64_t len;
+  uint8_t nonce[8];
+};
+
+struct shared {
+  uint32_t magic, version, entries, mode;
+  uint64_t sq_off, cq_off, payload_off, payload_size, size;
+  // Client
+  uint32_t sq_tail        __attribute__((aligned(64)));
+  uint32_t cq_head        __attribute__((aligned(64)));
+  uint32_t client_waiting __attribute__((aligned(64)));
+  // Service
+  uint32_t sq_head        __attribute__((aligned(64)));
+  uint32_t cq_tail        __attribute__((aligned(64)));
+  uint32_t service_idle   __attribute__((aligned(64)));
+};
+
+// Handshake on the socket
+struct hello {
+  uint32_t magic, version, entries, mode;
+  uint64_t payload_size;
+};
+
+struct welcome {
+  int32_t status;
+  uint32_t entries;
+  uint64_t sq_off, cq_off, payload_off, payload_size, size;
+};
+
+struct tagipc_client {
+  int sock, sq_efd, cq_efd;
+  enum tagipc_mode mode;
+  struct shared * sh;
+  struct desc * sq;
+  struct tagipc_completion * cq;
+  uint8_t * payload;
+  uint64_t payload_size, size;
+  unsigned entries;
+  uint32_t sq_tail;    // Local, published by tagipc_flush
+  uint32_t published;
+  uint32_t cq_head;
+  uint32_t pending;    // Submitted, not reaped
+};
+
+// The peer closed its end of the socket, or sent something: nothing
+// is expected after the handshake, and unread data would keep the
+// socket readable (sleep_on would spin)
+static int peer_gone (int sock) {
+  char b;
+  ssize_t r = recv(sock, &b, 1, MSG_DONTWAIT|MSG_PEEK);
+  return r >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+static void wake (int efd) {
+  uint64_t one = 1;
+  while (write(efd, &one, 8) < 0 && errno == EINTR)
+    ;
+}
+
+// Block until efd is signaled or the peer is gone (returns -1)
+static int sleep_on (int efd, int sock) {
+  struct pollfd p[2] = { { efd, POLLIN, 0 }, { sock, POLLIN, 0 } };
+  while (poll(p, 2, -1) < 0)
+    if (errno != EINTR)
+      return -1;
+  if (p[1].revents && peer_gone(sock))
+    return -1;
+  uint64_t n;
+  if (p[0].revents)
+    while (read(efd, &n, 8) < 0 && errno == EINTR)
+      ;
+  return 0;
+}
+
+/*
+ * Client
+ */
+
+struct tagipc_client * tagipc_attach (int sock, unsigned entries, size_t payload_size, enum tagipc_mode mode) {
+  struct hello h = { MAGIC, VERSION, entries, mode, payload_size };
+  if (send(sock, &h, sizeof(h), MSG_NOSIGNAL) != sizeof(h))
+    return NULL;
+
+  struct welcome w;
+  int fds[3];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = { &w, sizeof(w) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  struct cmsghdr * cm = CMSG_FIRSTHDR(&msg);
+  if (r != sizeof(w) || w.status) {
+    errno = r == sizeof(w)? w.status: EPROTO;
+    return NULL;
+  }
+  if (!cm || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    errno = EPROTO;
+    return NULL;
+  }
+  memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+
+  struct tagipc_client * c = calloc(1, sizeof(*c));
+  void * m = mmap(NULL, w.size, PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0);
+  close(fds[0]);
+  if (!c || m == MAP_FAILED) {
+    int err = c? errno: ENOMEM;
+    if (m != MAP_FAILED)
+      munmap(m, w.size);
+    free(c);
+    close(fds[1]);
+    close(fds[2]);
+    errno = err;
+    return NULL;
+  }
+  c->sock = sock;
+  c->sq_efd = fds[1];
+  c->cq_efd = fds[2];
+  c->mode = mode;
+  c->sh = m;
+  c->size = w.size;
+  c->entries = w.entries;
+  c->sq = (struct desc *)((uint8_t *)m + w.sq_off);
+  c->cq = (struct tagipc_completion *)((uint8_t *)m + w.cq_off);
+  c->payload = (uint8_t *)m + w.payload_off;
+  c->payload_size = w.payload_size;
+  return c;
+}
+
+struct tagipc_client * tagipc_connect (const char * path, unsigned entries, size_t payload_size, enum tagipc_mode mode) {
+  struct sockaddr_un a;
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+  strcpy(a.sun_path, path);
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return NULL;
+  struct tagipc_client * c = connect(sock, (struct sockaddr *)&a, sizeof(a))? NULL:
+    tagipc_attach(sock, entries, payload_size, mode);
+  if (!c) {
+    int err = errno;
+    close(sock);
+    errno = err;
+  }
+  return c;
+}
+
+void tagipc_close (struct tagipc_client * c) {
+  munmap(c->sh, c->size);
+  close(c->sq_efd);
+  close(c->cq_efd);
+  close(c->sock);
+  free(c);
+}
+
+uint8_t * tagipc_payload (const struct tagipc_client * c, size_t * size) {
+  if (size)
+    *size = c->payload_size;
+  return c->payload;
+}
+
+unsigned tagipc_entries (const struct tagipc_client * c) {
+  return c->entries;
+}
+
+int tagipc_submit (struct tagipc_client * c, const uint8_t * m, size_t len, const uint8_t nonce[8], uint64_t id) {
+  if (m < c->payload || len > c->payload_size || (uint64_t)(m - c->payload) > c->payload_size - len) {
+    errno = EINVAL;
+    return -1;
+  }
+  // At most entries in flight: the completion ring cannot overflow
+  if (c->pending >= c->entries) {
+    errno = EAGAIN;
+    return -1;
+  }
+  struct desc * d = &c->sq[c->sq_tail & (c->entries-1)];
+  d->id = id;
+  d->off = m - c->payload;
+  d->len = len;
+  memcpy(d->nonce, nonce, 8);
+  c->sq_tail++;
+  c->pending++;
+  return 0;
+}
+
+void tagipc_flush (struct tagipc_client * c) {
+  if (c->published == c->sq_tail)
+    return;
+  STORE(&c->sh->sq_tail, c->sq_tail);
+  c->published = c->sq_tail;
+  if (c->mode == TAGIPC_EVENTFD) {
+    FENCE();
+    if (__atomic_load_n(&c->sh->service_idle, __ATOMIC_RELAXED))
+      wake(c->sq_efd);
+  }
+}
+
+int tagipc_reap (struct tagipc_client * c, struct tagipc_completion * out, int max, int wait) {
+  tagipc_flush(c);
+  for (unsigned spins = 1; ; spins++) {
+    uint32_t tail = LOAD(&c->sh->cq_tail);
+    uint32_t n = tail - c->cq_head;
+    if (n > 0) {
+      if (n > (uint32_t)max)
+	n = max;
+      for (uint32_t i=0; i<n; i++)
+	out[i] = c->cq[(c->cq_head+i) & (c->entries-1)];
+      c->cq_head += n;
+      STORE(&c->sh->cq_head, c->cq_head);
+      c->pending -= n;
+      return n;
+    }
+    if (!wait || c->pending == 0)
+      return 0;
+
+    if (c->mode == TAGIPC_POLL) {
+      if (spins % SPIN_YIELD == 0) {
+	if (peer_gone(c->sock))
+	  return -1;
+	sched_yield();
+      }
+      cpu_relax();
+      continue;
+    }
+    STORE(&c->sh->client_waiting, 1);
+    FENCE();
+    if (LOAD(&c->sh->cq_tail) == c->cq_head && sleep_on(c->cq_efd, c->sock)) {
+      STORE(&c->sh->client_waiting, 0);
+      return -1;
+    }
+    STORE(&c->sh->client_waiting, 0);
+  }
+}
+
+int tagipc_tag (struct tagipc_client * c, const uint8_t * m, size_t len, const uint8_t nonce[8], uint8_t tag[8]) {
+  struct tagipc_completion r;
+  if (c->pending || tagipc_submit(c, m, len, nonce, 0) || tagipc_reap(c, &r, 1, 1) != 1)
+    return -1;
+  if (r.status) {
+    errno = r.status;
+    return -1;
+  }
+  memcpy(tag, r.tag, 8);
+  return 0;
+}
+
+/*
+ * Service
+ */
+
+int tagipc_listen (const char * path) {
+  struct sockaddr_un a;
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(a.sun_path, path);
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return -1;
+  unlink(path);
+  if (bind(sock, (struct sockaddr *)&a, sizeof(a)) || listen(sock, 64)) {
+    int err = errno;
+    close(sock);
+    errno = err;
+    return -1;
+  }
+  return sock;
+}
+
+static int send_welcome (int sock, const struct welcome * w, const int fds[3]) {
+  char control[CMSG_SPACE(3*sizeof(int))];
+  struct iovec iov = { (void *)w, sizeof(*w) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (fds) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr * cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(3*sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, 3*sizeof(int));
+  }
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(*w)? 0: errno;
+}
+
+static void serve_loop (const struct MAC611_context * ctx, int sock, int sq_efd, int cq_efd,
+			struct shared * sh, const struct welcome * w, enum tagipc_mode mode) {
+  const struct desc * sq = (const struct desc *)((uint8_t *)sh + w->sq_off);
+  struct tagipc_completion * cq = (struct tagipc_completion *)((uint8_t *)sh + w->cq_off);
+  const uint8_t * payload = (const uint8_t *)sh + w->payload_off;
+  uint32_t mask = w->entries-1, head = 0, cq_tail = 0;
+
+  for (unsigned spins = 1; ; spins++) {
+    uint32_t tail = LOAD(&sh->sq_tail);
+    if (tail - head > w->entries)
+      return; // Corrupted by the client
+
+    if (tail != head) {
+      for (int n = 0; head != tail && n < BATCH; n++, head++, cq_tail++) {
+	struct desc d;
+	memcpy(&d, &sq[head & mask], sizeof(d)); // Checked after the copy
+	struct tagipc_completion * r = &cq[cq_tail & mask];
+	r->id = d.id;
+	if (d.off > w->payload_size || d.len > w->payload_size - d.off) {
+	  r->status = EINVAL;
+	  memset(r->tag, 0, 8);
+	} else {
+	  r->status = 0;
+	  MAC611_tag(ctx, payload + d.off, d.len, d.nonce, r->tag);
+	}
+      }
+      STORE(&sh->cq_tail, cq_tail);
+      STORE(&sh->sq_head, head);
+      if (mode == TAGIPC_EVENTFD) {
+	FENCE();
+	if (__atomic_load_n(&sh->client_waiting, __ATOMIC_RELAXED))
+	  wake(cq_efd);
+      }
+      spins = 0;
+      continue;
+    }
+
+    if (mode == TAGIPC_POLL) {
+      if (spins % SPIN_YIELD == 0) {
+	if (peer_gone(sock))
+	  return;
+	sched_yield();
+      }
+      cpu_relax();
+      continue;
+    }
+    STORE(&sh->service_idle, 1);
+    FENCE();
+    if (LOAD(&sh->sq_tail) == head && sleep_on(sq_efd, sock))
+      return;
+    STORE(&sh->service_idle, 0);
+  }
+}
+
+int tagipc_serve (const struct MAC611_context * ctx, int sock) {
+  struct hello h;
+  struct welcome w;
+  memset(&w, 0, sizeof(w));
+  if (recv(sock, &h, sizeof(h), 0) != sizeof(h) || h.magic != MAGIC || h.version != VERSION ||
+      (h.mode != TAGIPC_EVENTFD && h.mode != TAGIPC_POLL) ||
+      h.payload_size == 0 || h.payload_size > MAX_PAYLOAD) {
+    w.status = EPROTO;
+    send_welcome(sock, &w, NULL);
+    return EPROTO;
+  }
+
+  // Layout
+  unsigned entries = 2;
+  while (entries < h.entries && entries < MAX_ENTRIES)
+    entries *= 2;
+  w.entries = entries;
+  w.sq_off = 4096;
+  w.cq_off = (w.sq_off + entries*sizeof(struct desc) + 63) / 64 * 64;
+  w.payload_off = (w.cq_off + entries*sizeof(struct tagipc_completion) + 4095) / 4096 * 4096;
+  w.payload_size = h.payload_size;
+  w.size = w.payload_off + (h.payload_size + 4095) / 4096 * 4096;
+
+  int fds[3] = { memfd_create("mac611-ipc", MFD_CLOEXEC|MFD_ALLOW_SEALING),
+		 eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK), eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK) };
+  struct shared * sh = MAP_FAILED;
+  int err = 0;
+  // Sealed size: the client cannot shrink the memfd under the service (SIGBUS)
+  if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0 || ftruncate(fds[0], w.size) ||
+      fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL))
+    err = errno;
+  else if ((sh = mmap(NULL, w.size, PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0)) == MAP_FAILED)
+    err = errno;
+
+  if (!err) {
+    sh->magic = MAGIC;
+    sh->version = VERSION;
+    sh->entries = entries;
+    sh->mode = h.mode;
+    sh->sq_off = w.sq_off;
+    sh->cq_off = w.cq_off;
+    sh->payload_off = w.payload_off;
+    sh->payload_size = w.payload_size;
+    sh->size = w.size;
+    err = send_welcome(sock, &w, fds);
+  } else {
+    w.status = err;
+    send_welcome(sock, &w, NULL);
+  }
+  if (fds[0] >= 0)
+    close(fds[0]); // The mapping stays
+
+  if (!err)
+    serve_loop(ctx, sock, fds[1], fds[2], sh, &w, h.mode);
+
+  if (sh != MAP_FAILED)
+    munmap(sh, w.size);
+  if (fds[1] >= 0)
+    close(fds[1]);
+  if (fds[2] >= 0)
+    close(fds[2]);
+  return err;
+}
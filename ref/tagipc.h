@@ -0,0 +1,76 @@
+/************************************************************
+ * MAC611 tools
+ * Shared-memory tagging service: the key stays in the service
+ * (c) 2018-2019 XXXX
+ *
+ * A client connects to the service with a Unix socket and gets a
+ * shared memory segment (memfd) with:
+ * - a payload region, where the client writes its messages
+ * - a submission ring (client -> service) of descriptors
+ *   pointing into the payload region: no copy of the messages
+ * - a completion ring (service -> client) with the tags
+ * Both rings are single-producer single-consumer and lock-free.
+ * Wakeups: TAGIPC_EVENTFD sleeps on eventfds when a ring is empty
+ * (a write only when the other side is asleep), TAGIPC_POLL spins
+ * on both sides (one CPU per client for the service).
+ ************************************************************/
+
+#ifndef TAGIPC_H
+#define TAGIPC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum tagipc_mode { TAGIPC_EVENTFD, TAGIPC_POLL };
+
+struct tagipc_completion {
+  uint64_t id;     // From tagipc_submit
+  int32_t status;  // 0, or EINVAL for a range outside the payload region
+  uint8_t tag[8];
+};
+
+struct tagipc_client;
+
+/*** Client ***/
+
+// entries: ring size (rounded up to a power of two), payload_size in bytes.
+// NULL on failure (errno set).
+struct tagipc_client * tagipc_connect (const char * path, unsigned entries, size_t payload_size, enum tagipc_mode mode);
+// Same with an already connected socket (e.g. from socketpair)
+struct tagipc_client * tagipc_attach (int sock, unsigned entries, size_t payload_size, enum tagipc_mode mode);
+void tagipc_close (struct tagipc_client * c);
+
+// Shared payload region: messages must be written there before submission
+uint8_t * tagipc_payload (const struct tagipc_client * c, size_t * size);
+unsigned  tagipc_entries (const struct tagipc_client * c);
+
+// Queue a message (m points into the payload region), not visible
+// to the service before tagipc_flush. Returns -1 when the ring is
+// full or entries messages are waiting to be reaped.
+int  tagipc_submit (struct tagipc_client * c, const uint8_t * m, size_t len, const uint8_t nonce[8], uint64_t id);
+// Publish the queued messages, wakes the service up if needed
+void tagipc_flush (struct tagipc_client * c);
+// Up to max completions; with wait, at least one (if any is pending).
+// Returns the number of completions, -1 if the service is gone.
+int  tagipc_reap (struct tagipc_client * c, struct tagipc_completion * out, int max, int wait);
+// Synchronous: submit, flush and wait for this tag (no other pending)
+int  tagipc_tag (struct tagipc_client * c, const uint8_t * m, size_t len, const uint8_t nonce[8], uint8_t tag[8]);
+
+/*** Service ***/
+
+// Listening socket at path (replaces a stale socket file), -1 on failure
+int  tagipc_listen (const char * path);
+// Handshake and service loop of one client, until it disconnects.
+// Returns 0, or an errno value if the handshake failed.
+int  tagipc_serve (const struct MAC611_context * ctx, int sock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAGIPC_H
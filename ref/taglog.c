@@ -0,0 +1,686 @@
+/************************************************************
+ * MAC611 tools
+ * Authenticated append-only record log
+ * (c) 2018-2019 XXXX
+ *
+ * Files, in the log directory, per segment (named after the
+ * sequence number of its first record, 16 hex digits):
+ * - <first>.log: a 64-byte header ("MAC611LG", version, first),
+ *   then the records, each one
+ *   seq (8) | len (4) | 0 (4) | data (len) | tag (8) | 0-7 bytes of
+ *   padding to a multiple of 8, all little endian, where tag is the
+ *   MAC611_tag of data with seq as nonce
+ * - <first>.idx: the offset (8 bytes) of each record
+ *
+ * Appenders take their sequence number and their place in the
+ * group under the lock, then compute their tag in parallel; the
+ * writer thread writes the whole group (data, then index) and
+ * syncs once. After a crash, the index can point to records that
+ * did not reach the disk: taglog_open checks the records of the
+ * last segment and drops everything from the first bad one.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "taglog.h"
+#include "workpool.h"
+#include "toolutil.h"
+
+#define SEG_MAGIC   "MAC611LG"
+#define SEG_VERSION 1
+#define SEG_HEADER  64
+#define REC_HEADER  16
+#define REC_SIZE(len) ((REC_HEADER + (uint64_t)(len) + 8 + 7) & ~(uint64_t)7)
+#define IOV_BATCH   1020 // Below IOV_MAX
+#define CHUNK       4096 // Records per verification task
+
+static char * seg_path (const char * dir, uint64_t first, const char * ext) {
+  char * p = malloc(strlen(dir) + 32);
+  if (p)
+    sprintf(p, "%s/%016" PRIx64 ".%s", dir, first, ext);
+  return p;
+}
+
+static int by_value (const void * a, const void * b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y? -1: x > y;
+}
+
+// First sequence numbers of the segments, sorted. -1 on failure.
+static int list_segments (const char * dir, uint64_t ** firsts, size_t * n) {
+  DIR * d = opendir(dir);
+  if (!d)
+    return -1;
+  size_t cap = 0;
+  *firsts = NULL;
+  *n = 0;
+  struct dirent * de;
+  while ((de = readdir(d))) {
+    char * end;
+    if (strlen(de->d_name) != 20 || strcmp(de->d_name+16, ".log"))
+      continue;
+    uint64_t first = strtoull(de->d_name, &end, 16);
+    if (end != de->d_name+16)
+      continue;
+    if (*n == cap) {
+      uint64_t * f = realloc(*firsts, (cap = cap? 2*cap: 16)*sizeof(uint64_t));
+      if (!f) {
+	free(*firsts);
+	closedir(d);
+	errno = ENOMEM;
+	return -1;
+      }
+      *firsts = f;
+    }
+    (*firsts)[(*n)++] = first;
+  }
+  closedir(d);
+  qsort(*firsts, *n, sizeof(uint64_t), by_value);
+  return 0;
+}
+
+static int pwrite_all (int fd, const void * p, size_t len, off_t off) {
+  while (len) {
+    ssize_t r = pwrite(fd, p, len, off);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return errno;
+    p = (const uint8_t *)p + r;
+    len -= r;
+    off += r;
+  }
+  return 0;
+}
+
+static int pwritev_all (int fd, struct iovec * iov, int n, off_t off) {
+  while (n > 0) {
+    ssize_t r = pwritev(fd, iov, n, off);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return errno;
+    off += r;
+    // Skip what was written
+    while (n > 0 && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Writer
+ */
+
+struct waiter {
+  const uint8_t * data;
+  size_t len;
+  uint64_t seq;
+  uint8_t head[REC_HEADER];
+  uint8_t tail[16];   // Tag and padding
+  int ready;          // Tagged by the appender
+  int done, err;
+  struct waiter * next;
+};
+
+struct taglog {
+  char * dir;
+  const struct MAC611_context * ctx;
+  size_t segment_size;
+  int sync;
+
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t work;      // To the writer: new or tagged records, stop
+  pthread_cond_t done;      // To the appenders: group committed
+  struct waiter * head, ** tail;
+  uint64_t next_seq;
+  int stop, err;            // err: sticky write error
+  struct taglog_counts counts;
+
+  // Writer thread only
+  int fd, idx_fd;
+  uint64_t seg_first, seg_count, size;
+  struct iovec iov[IOV_BATCH];
+  int niov;
+  uint8_t * idx;            // Pending index entries
+  size_t nidx, idx_cap;
+  uint64_t pending;         // Pending bytes
+};
+
+static int sync_dir (const char * dir) {
+  int fd = open(dir, O_RDONLY|O_DIRECTORY);
+  if (fd < 0)
+    return errno;
+  int err = fsync(fd)? errno: 0;
+  close(fd);
+  return err;
+}
+
+static int seg_create (struct taglog * log, uint64_t first) {
+  char * p = seg_path(log->dir, first, "log");
+  char * q = seg_path(log->dir, first, "idx");
+  int err = p && q? 0: ENOMEM;
+  if (!err && (log->fd = open(p, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0)
+    err = errno;
+  if (!err && (log->idx_fd = open(q, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0) {
+    err = errno;
+    close(log->fd);
+  }
+  free(p);
+  free(q);
+  if (err)
+    return err;
+
+  uint8_t h[SEG_HEADER] = {0};
+  memcpy(h, SEG_MAGIC, 8);
+  put32(h+8, SEG_VERSION);
+  put64(h+16, first);
+  err = pwrite_all(log->fd, h, sizeof(h), 0);
+  if (!err && log->sync)
+    err = sync_dir(log->dir);
+  log->seg_first = first;
+  log->seg_count = 0;
+  log->size = SEG_HEADER;
+  return err;
+}
+
+// Write the pending records, then their index entries
+static int flush (struct taglog * log) {
+  int err = log->niov? pwritev_all(log->fd, log->iov, log->niov, log->size): 0;
+  if (!err && log->nidx)
+    err = pwrite_all(log->idx_fd, log->idx, 8*log->nidx, 8*log->seg_count);
+  if (!err) {
+    log->size += log->pending;
+    log->seg_count += log->nidx;
+  }
+  log->niov = 0;
+  log->nidx = 0;
+  log->pending = 0;
+  return err;
+}
+
+static int sync_segment (struct taglog * log) {
+  if (!log->sync)
+    return 0;
+  if (fdatasync(log->fd) || fdatasync(log->idx_fd))
+    return errno;
+  return 0;
+}
+
+static int commit (struct taglog * log, struct waiter * batch) {
+  int err = 0;
+  for (struct waiter * w = batch; w && !err; w = w->next) {
+    uint64_t rs = REC_SIZE(w->len);
+    if (log->seg_count + log->nidx > 0 && log->size + log->pending + rs > log->segment_size) {
+      err = flush(log);
+      err = err? err: sync_segment(log);
+      if (err)
+	break;
+      close(log->fd);
+      close(log->idx_fd);
+      if ((err = seg_create(log, w->seq)))
+	break;
+    }
+    if (log->niov + 3 > IOV_BATCH && (err = flush(log)))
+      break;
+    if (log->nidx == log->idx_cap) {
+      size_t cap = log->idx_cap? 2*log->idx_cap: 1024;
+      uint8_t * idx = realloc(log->idx, 8*cap);
+      if (!idx) {
+	err = ENOMEM;
+	break;
+      }
+      log->idx = idx;
+      log->idx_cap = cap;
+    }
+    put64(log->idx + 8*log->nidx++, log->size + log->pending);
+    log->iov[log->niov++] = (struct iovec){ w->head, REC_HEADER };
+    if (w->len)
+      log->iov[log->niov++] = (struct iovec){ (void *)w->data, w->len };
+    log->iov[log->niov++] = (struct iovec){ w->tail, rs - REC_HEADER - w->len };
+    log->pending += rs;
+  }
+  if (!err)
+    err = flush(log);
+  if (!err)
+    err = sync_segment(log);
+  return err;
+}
+
+static void * writer_run (void * arg) {
+  struct taglog * log = arg;
+  pthread_mutex_lock(&log->lock);
+  for (;;) {
+    while (!log->head && !log->stop)
+      pthread_cond_wait(&log->work, &log->lock);
+    if (!log->head)
+      break;
+
+    // The group: everything queued, once tagged by the appenders
+    struct waiter * batch = log->head;
+    log->head = NULL;
+    log->tail = &log->head;
+    for (struct waiter * w = batch; w; w = w->next)
+      while (!w->ready)
+	pthread_cond_wait(&log->work, &log->lock);
+    int err = log->err;
+    pthread_mutex_unlock(&log->lock);
+
+    if (!err)
+      err = commit(log, batch);
+
+    pthread_mutex_lock(&log->lock);
+    if (err && !log->err)
+      log->err = err;
+    uint64_t n = 0;
+    for (struct waiter * w = batch, * next; w; w = next, n++) {
+      next = w->next; // w is gone once done and the lock released
+      w->err = err;
+      w->done = 1;
+    }
+    log->counts.groups++;
+    log->counts.records += n;
+    pthread_cond_broadcast(&log->done);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return NULL;
+}
+
+// Last segment: keep the records up to the first bad one
+static int recover (struct taglog * log, uint64_t first) {
+  char * p = seg_path(log->dir, first, "log");
+  char * q = seg_path(log->dir, first, "idx");
+  int err = p && q? 0: ENOMEM;
+  if (!err && (log->fd = open(p, O_RDWR|O_CLOEXEC)) < 0)
+    err = errno;
+  if (!err && (log->idx_fd = open(q, O_RDWR|O_CREAT|O_CLOEXEC, 0644)) < 0) {
+    err = errno;
+    close(log->fd);
+  }
+  free(p);
+  free(q);
+  if (err)
+    return err;
+
+  struct stat st, ist;
+  if (fstat(log->fd, &st) || fstat(log->idx_fd, &ist)) {
+    err = errno;
+  } else {
+    uint8_t h[SEG_HEADER];
+    if (st.st_size < SEG_HEADER || pread(log->fd, h, SEG_HEADER, 0) != SEG_HEADER ||
+	memcmp(h, SEG_MAGIC, 8) || get32(h+8) != SEG_VERSION || get64(h+16) != first) {
+      // Torn creation: start the segment again
+      close(log->fd);
+      close(log->idx_fd);
+      return seg_create(log, first);
+    }
+  }
+
+  uint64_t n = err? 0: ist.st_size/8, count = 0, off = SEG_HEADER;
+  const uint8_t * map = NULL, * idx = NULL;
+  if (n) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, log->fd, 0);
+    idx = mmap(NULL, n*8, PROT_READ, MAP_SHARED, log->idx_fd, 0);
+    if (map == MAP_FAILED || idx == MAP_FAILED)
+      err = errno;
+  }
+  for (; !err && count < n; count++) {
+    if (get64(idx + 8*count) != off || (uint64_t)st.st_size - off < REC_HEADER+8)
+      break;
+    const uint8_t * rec = map + off;
+    uint64_t len = get32(rec+8), rs = REC_SIZE(len);
+    if (get64(rec) != first+count || rs > (uint64_t)st.st_size - off)
+      break;
+    if (!MAC611_verify(log->ctx, rec+REC_HEADER, len, rec, rec+REC_HEADER+len))
+      break;
+    off += rs;
+  }
+  if (map && map != MAP_FAILED)
+    munmap((void *)map, st.st_size);
+  if (idx && idx != MAP_FAILED)
+    munmap((void *)idx, n*8);
+
+  if (!err && (ftruncate(log->fd, off) || ftruncate(log->idx_fd, 8*count)))
+    err = errno;
+  if (err) {
+    close(log->fd);
+    close(log->idx_fd);
+    return err;
+  }
+  log->seg_first = first;
+  log->seg_count = count;
+  log->size = off;
+  return 0;
+}
+
+struct taglog * taglog_open (const char * dir, const struct MAC611_context * ctx, const struct taglog_options * o) {
+  if (mkdir(dir, 0755) && errno != EEXIST)
+    return NULL;
+  struct taglog * log = calloc(1, sizeof(*log));
+  if (!log || !(log->dir = strdup(dir))) {
+    free(log);
+    errno = ENOMEM;
+    return NULL;
+  }
+  log->ctx = ctx;
+  log->segment_size = o && o->segment_size? o->segment_size: 64<<20;
+  log->sync = o? o->sync: 0;
+  log->tail = &log->head;
+
+  uint64_t * firsts;
+  size_t n;
+  int err = list_segments(dir, &firsts, &n)? errno: 0;
+  if (!err) {
+    err = n? recover(log, firsts[n-1]): seg_create(log, 0);
+    free(firsts);
+  }
+  if (!err) {
+    log->next_seq = log->seg_first + log->seg_count;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->work, NULL);
+    pthread_cond_init(&log->done, NULL);
+    if ((err = pthread_create(&log->writer, NULL, writer_run, log))) {
+      close(log->fd);
+      close(log->idx_fd);
+    }
+  }
+  if (err) {
+    free(log->dir);
+    free(log);
+    errno = err;
+    return NULL;
+  }
+  return log;
+}
+
+int taglog_append (struct taglog * log, const void * data, size_t len, uint64_t * seq) {
+  if (len > UINT32_MAX)
+    return EINVAL;
+  struct waiter w;
+  memset(&w, 0, sizeof(w));
+  w.data = data;
+  w.len = len;
+
+  pthread_mutex_lock(&log->lock);
+  if (log->err || log->stop) {
+    int err = log->err? log->err: EBADF;
+    pthread_mutex_unlock(&log->lock);
+    return err;
+  }
+  w.seq = log->next_seq++;
+  *log->tail = &w;
+  log->tail = &w.next;
+  pthread_cond_signal(&log->work);
+  pthread_mutex_unlock(&log->lock);
+
+  // Tagged outside of the lock
+  put64(w.head, w.seq);
+  put32(w.head+8, len);
+  MAC611_tag(log->ctx, data, len, w.head, w.tail);
+
+  pthread_mutex_lock(&log->lock);
+  w.ready = 1;
+  pthread_cond_signal(&log->work);
+  while (!w.done)
+    pthread_cond_wait(&log->done, &log->lock);
+  pthread_mutex_unlock(&log->lock);
+
+  if (seq)
+    *seq = w.seq;
+  return w.err;
+}
+
+void taglog_counts (struct taglog * log, struct taglog_counts * c) {
+  pthread_mutex_lock(&log->lock);
+  *c = log->counts;
+  pthread_mutex_unlock(&log->lock);
+}
+
+void taglog_close (struct taglog * log) {
+  pthread_mutex_lock(&log->lock);
+  log->stop = 1;
+  pthread_cond_signal(&log->work);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->writer, NULL);
+
+  close(log->fd);
+  close(log->idx_fd);
+  pthread_mutex_destroy(&log->lock);
+  pthread_cond_destroy(&log->work);
+  pthread_cond_destroy(&log->done);
+  free(log->idx);
+  free(log->dir);
+  free(log);
+}
+
+/*
+ * Readers
+ */
+
+struct segment {
+  uint64_t first, count;
+  const uint8_t * map, * idx;
+  size_t size;
+};
+
+struct taglog_reader {
+  const struct MAC611_context * ctx;
+  struct segment * seg;
+  size_t nseg;
+};
+
+static int seg_map (const char * dir, uint64_t first, struct segment * s) {
+  char * p = seg_path(dir, first, "log");
+  char * q = seg_path(dir, first, "idx");
+  int fd = p? open(p, O_RDONLY|O_CLOEXEC): -1;
+  int ifd = q? open(q, O_RDONLY|O_CLOEXEC): -1;
+  free(p);
+  free(q);
+  // The index first: the writer appends records before indexing
+  // them, so every offset of this index is within the log size
+  // read next (offsets beyond it would still fail the record check)
+  struct stat st, ist;
+  int err = fd < 0 || ifd < 0 || fstat(ifd, &ist) || fstat(fd, &st)? errno: 0;
+
+  s->first = first;
+  s->size = err? 0: st.st_size;
+  s->count = err? 0: ist.st_size/8;
+  s->map = s->idx = NULL;
+  if (!err && s->size < SEG_HEADER)
+    err = EBADMSG;
+  if (!err && (s->map = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    err = errno;
+  if (!err && s->count && (s->idx = mmap(NULL, 8*s->count, PROT_READ, MAP_SHARED, ifd, 0)) == MAP_FAILED)
+    err = errno;
+  if (!err && (memcmp(s->map, SEG_MAGIC, 8) || get32(s->map+8) != SEG_VERSION || get64(s->map+16) != first))
+    err = EBADMSG;
+  if (s->map == MAP_FAILED)
+    s->map = NULL;
+  if (s->idx == MAP_FAILED)
+    s->idx = NULL;
+  if (fd >= 0)
+    close(fd);
+  if (ifd >= 0)
+    close(ifd);
+  return err;
+}
+
+static void seg_unmap (struct segment * s) {
+  if (s->map)
+    munmap((void *)s->map, s->size);
+  if (s->idx)
+    munmap((void *)s->idx, 8*s->count);
+}
+
+struct taglog_reader * taglog_reader_open (const char * dir, const struct MAC611_context * ctx) {
+  uint64_t * firsts;
+  size_t n;
+  if (list_segments(dir, &firsts, &n))
+    return NULL;
+  struct taglog_reader * r = calloc(1, sizeof(*r));
+  struct segment * seg = calloc(n? n: 1, sizeof(*seg));
+  int err = r && seg? 0: ENOMEM;
+  for (size_t i=0; !err && i<n; i++) {
+    err = seg_map(dir, firsts[i], &seg[i]);
+    if (err)
+      seg_unmap(&seg[i]);
+    else
+      madvise((void *)seg[i].map, seg[i].size, MADV_WILLNEED);
+    r->nseg = err? i: i+1;
+  }
+  free(firsts);
+  if (err) {
+    if (r) {
+      r->seg = seg;
+      taglog_reader_close(r);
+    } else {
+      free(seg);
+    }
+    errno = err;
+    return NULL;
+  }
+  r->ctx = ctx;
+  r->seg = seg;
+  return r;
+}
+
+void taglog_reader_close (struct taglog_reader * r) {
+  for (size_t i=0; i<r->nseg; i++)
+    seg_unmap(&r->seg[i]);
+  free(r->seg);
+  free(r);
+}
+
+uint64_t taglog_first (const struct taglog_reader * r) {
+  return r->nseg? r->seg[0].first: 0;
+}
+
+uint64_t taglog_count (const struct taglog_reader * r) {
+  if (!r->nseg)
+    return 0;
+  const struct segment * last = &r->seg[r->nseg-1];
+  return last->first + last->count - r->seg[0].first;
+}
+
+// Record i of s, checked: bounds, sequence number and tag.
+// Returns the offset of the next record, 0 if the record is bad.
+static uint64_t check (const struct taglog_reader * r, const struct segment * s, uint64_t i,
+		       const uint8_t ** data, size_t * len) {
+  uint64_t off = get64(s->idx + 8*i);
+  if (off < SEG_HEADER || off > s->size || s->size - off < REC_HEADER+8)
+    return 0;
+  const uint8_t * rec = s->map + off;
+  uint64_t l = get32(rec+8), rs = REC_SIZE(l);
+  if (get64(rec) != s->first+i || rs > s->size - off)
+    return 0;
+  if (!MAC611_verify(r->ctx, rec+REC_HEADER, l, rec, rec+REC_HEADER+l))
+    return 0;
+  if (data) {
+    *data = rec+REC_HEADER;
+    *len = l;
+  }
+  return off + rs;
+}
+
+int taglog_get (const struct taglog_reader * r, uint64_t seq, const uint8_t ** data, size_t * len) {
+  // Last segment starting at or before seq
+  size_t lo = 0, hi = r->nseg;
+  while (hi - lo > 1) {
+    size_t mid = (lo+hi)/2;
+    if (r->seg[mid].first <= seq)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  if (!r->nseg || seq < r->seg[lo].first || seq - r->seg[lo].first >= r->seg[lo].count)
+    return ENOENT;
+  return check(r, &r->seg[lo], seq - r->seg[lo].first, data, len)? 0: EBADMSG;
+}
+
+struct verify_task {
+  const struct taglog_reader * r;
+  const struct segment * s;
+  uint64_t begin, end;
+  uint64_t * bad;     // Lowest bad sequence number (atomic min)
+};
+
+static void bad_seq (uint64_t * bad, uint64_t seq) {
+  uint64_t cur = __atomic_load_n(bad, __ATOMIC_RELAXED);
+  while (seq < cur && !__atomic_compare_exchange_n(bad, &cur, seq, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+static void verify_run (void * arg) {
+  struct verify_task * t = arg;
+  const struct segment * s = t->s;
+  // Records must follow each other: the first one of the range
+  // starts where the previous one ends
+  uint64_t expected = SEG_HEADER;
+  if (t->begin > 0) {
+    uint64_t off = get64(s->idx + 8*(t->begin-1));
+    expected = off <= s->size - REC_HEADER? off + REC_SIZE(get32(s->map + off + 8)): 0;
+  }
+  for (uint64_t i = t->begin; i < t->end; i++) {
+    uint64_t next = get64(s->idx + 8*i) == expected? check(t->r, s, i, NULL, NULL): 0;
+    if (!next) {
+      bad_seq(t->bad, s->first+i);
+      return;
+    }
+    expected = next;
+  }
+}
+
+int taglog_verify (const struct taglog_reader * r, int threads, uint64_t * bad) {
+  uint64_t first_bad = UINT64_MAX;
+  size_t ntasks = 0;
+  for (size_t i=0; i<r->nseg; i++) {
+    ntasks += (r->seg[i].count + CHUNK-1) / CHUNK;
+    // Segments must follow each other
+    if (i > 0 && r->seg[i].first != r->seg[i-1].first + r->seg[i-1].count)
+      bad_seq(&first_bad, r->seg[i-1].first + r->seg[i-1].count);
+  }
+
+  struct verify_task * tasks = calloc(ntasks? ntasks: 1, sizeof(*tasks));
+  struct workpool * pool = tasks? workpool_create(threads): NULL;
+  if (!pool) {
+    free(tasks);
+    return ENOMEM;
+  }
+  size_t k = 0;
+  for (size_t i=0; i<r->nseg; i++)
+    for (uint64_t b=0; b<r->seg[i].count; b+=CHUNK, k++) {
+      tasks[k] = (struct verify_task){ r, &r->seg[i], b, b+CHUNK < r->seg[i].count? b+CHUNK: r->seg[i].count, &first_bad };
+      if (workpool_submit(pool, verify_run, &tasks[k]))
+	verify_run(&tasks[k]);
+    }
+  workpool_wait(pool);
+  workpool_destroy(pool);
+  free(tasks);
+
+  if (first_bad == UINT64_MAX)
+    return 0;
+  if (bad)
+    *bad = first_bad;
+  return EBADMSG;
+}
@@ -0,0 +1,69 @@
+/************************************************************
+ * MAC611 tools
+ * Authenticated append-only record log
+ * (c) 2018-2019 XXXX
+ *
+ * A log is a directory of segments. Each record holds its length,
+ * its sequence number (the nonce of its tag) and the MAC611_tag
+ * of its data. Each segment has an index of record offsets, for
+ * random access to one record and for parallel verification.
+ *
+ * Appends from any thread are committed by a single writer thread
+ * in groups: one write and (with sync) one fdatasync per group.
+ * Readers map a snapshot of the log, independently of the writer.
+ ************************************************************/
+
+#ifndef TAGLOG_H
+#define TAGLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct taglog_options {
+  size_t segment_size;  // Bytes per segment before a new one (0: 64 MiB)
+  int sync;             // fdatasync each group before the appends return
+};
+
+struct taglog_counts {
+  uint64_t records;     // Appended since taglog_open
+  uint64_t groups;      // Groups committed
+};
+
+/*** Writer ***/
+
+struct taglog;
+
+// Opens or creates the log in dir. Records appended but not indexed
+// when the writer stopped (crash) are dropped. NULL on failure (errno).
+struct taglog * taglog_open (const char * dir, const struct MAC611_context * ctx, const struct taglog_options * o);
+// Thread-safe, returns once the record is committed with its
+// sequence number in *seq (can be NULL). 0 or an errno value.
+int  taglog_append (struct taglog * log, const void * data, size_t len, uint64_t * seq);
+void taglog_counts (struct taglog * log, struct taglog_counts * c);
+void taglog_close (struct taglog * log);
+
+/*** Readers ***/
+
+struct taglog_reader;
+
+struct taglog_reader * taglog_reader_open (const char * dir, const struct MAC611_context * ctx);
+void     taglog_reader_close (struct taglog_reader * r);
+// Records in the snapshot: sequence numbers [first, first+count)
+uint64_t taglog_first (const struct taglog_reader * r);
+uint64_t taglog_count (const struct taglog_reader * r);
+// One record, verified: 0, ENOENT (no such record) or EBADMSG
+int taglog_get (const struct taglog_reader * r, uint64_t seq, const uint8_t ** data, size_t * len);
+// All records with threads threads (<= 0: online CPUs). Returns 0, or
+// EBADMSG with the first failing sequence number in *bad.
+int taglog_verify (const struct taglog_reader * r, int threads, uint64_t * bad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAGLOG_H
@@ -0,0 +1,397 @@
+/************************************************************
+ * MAC611 tools
+ * Double-buffered tagging of files and pipes
+ * (c) 2018-2019 XXXX
+ *
+ * io_uring is used through the raw system calls (no liburing):
+ * one read is in flight per free buffer, and buffers are hashed
+ * in file order as their reads complete. A short read is
+ * completed with pread; a read of 0 bytes is the end of file.
+ * Kernels with io_uring but without IORING_OP_READ (before 5.6, no
+ * IORING_REGISTER_PROBE either) are treated as without io_uring.
+ * The thread backend fills the same ring from a reader thread.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#include "tagstream.h"
+
+#define ALIGN 4096 // Buffers can be used with O_DIRECT
+
+struct ring {
+  uint8_t ** buf;
+  size_t size;
+  int n;
+};
+
+static int ring_alloc (struct ring * r, const struct tagstream_options * o) {
+  r->size = o && o->buffer_size? (o->buffer_size+ALIGN-1)/ALIGN*ALIGN: 1<<20;
+  r->n = o && o->buffers > 0? o->buffers: 4;
+  r->buf = calloc(r->n, sizeof(*r->buf));
+  if (!r->buf)
+    return ENOMEM;
+  for (int i=0; i<r->n; i++)
+    if (posix_memalign((void **)&r->buf[i], ALIGN, r->size))
+      return ENOMEM;
+  return 0;
+}
+
+static void ring_free (struct ring * r) {
+  if (r->buf)
+    for (int i=0; i<r->n; i++)
+      free(r->buf[i]);
+  free(r->buf);
+}
+
+// Fill p with up to len bytes, stops at the end of file
+static ssize_t fill (int fd, uint8_t * p, size_t len, off_t off, int seekable) {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t r = seekable? pread(fd, p+got, len-got, off+got): read(fd, p+got, len-got);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return -errno;
+    if (r == 0)
+      break;
+    got += r;
+  }
+  return got;
+}
+
+/*
+ * Reader thread
+ */
+
+struct slot {
+  size_t len;
+  int err;
+  int full;
+};
+
+struct reader {
+  int fd, seekable;
+  off_t off;
+  struct ring * r;
+  struct slot * s;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void * reader_run (void * arg) {
+  struct reader * rd = arg;
+  for (int i=0; ; i = (i+1) % rd->r->n) {
+    pthread_mutex_lock(&rd->lock);
+    while (rd->s[i].full)
+      pthread_cond_wait(&rd->cond, &rd->lock);
+    pthread_mutex_unlock(&rd->lock);
+
+    ssize_t got = fill(rd->fd, rd->r->buf[i], rd->r->size, rd->off, rd->seekable);
+    rd->off += got > 0? got: 0;
+
+    pthread_mutex_lock(&rd->lock);
+    rd->s[i].len = got > 0? got: 0;
+    rd->s[i].err = got < 0? -got: 0;
+    rd->s[i].full = 1;
+    pthread_cond_broadcast(&rd->cond);
+    pthread_mutex_unlock(&rd->lock);
+
+    // A partial buffer is the last one
+    if (got < (ssize_t)rd->r->size)
+      return NULL;
+  }
+}
+
+static int tag_thread (struct MAC611_stream * st, int fd, off_t off, int seekable, struct ring * r) {
+  struct reader rd = { fd, seekable, off, r, calloc(r->n, sizeof(struct slot)),
+		       PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+  pthread_t t;
+  if (!rd.s)
+    return ENOMEM;
+  int err = pthread_create(&t, NULL, reader_run, &rd);
+  if (err) {
+    free(rd.s);
+    return err;
+  }
+
+  for (int i=0; ; i = (i+1) % r->n) {
+    pthread_mutex_lock(&rd.lock);
+    while (!rd.s[i].full)
+      pthread_cond_wait(&rd.cond, &rd.lock);
+    size_t len = rd.s[i].len;
+    err = rd.s[i].err;
+    pthread_mutex_unlock(&rd.lock);
+
+    if (err)
+      break;
+    MAC611_update(st, r->buf[i], len);
+    if (len < r->size)
+      break;
+
+    pthread_mutex_lock(&rd.lock);
+    rd.s[i].full = 0;
+    pthread_cond_broadcast(&rd.cond);
+    pthread_mutex_unlock(&rd.lock);
+  }
+
+  pthread_join(t, NULL);
+  pthread_mutex_destroy(&rd.lock);
+  pthread_cond_destroy(&rd.cond);
+  free(rd.s);
+  return err;
+}
+
+/*
+ * io_uring
+ */
+
+// IORING_OP_READ is an enum: test a flag of the same kernel headers (5.7)
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_FAST_POLL)
+struct uring {
+  int fd;
+  unsigned * sq_tail, * sq_mask, * sq_array;
+  unsigned * cq_head, * cq_tail, * cq_mask;
+  struct io_uring_sqe * sqes;
+  struct io_uring_cqe * cqes;
+  void * sq_ptr, * cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+};
+
+static int uring_setup (struct uring * u, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(u, 0, sizeof(*u));
+  u->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0)
+    return errno;
+
+  u->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  u->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    u->sq_size = u->cq_size = u->sq_size > u->cq_size? u->sq_size: u->cq_size;
+  u->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+
+  u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  u->cq_ptr = p.features & IORING_FEAT_SINGLE_MMAP? u->sq_ptr:
+    mmap(NULL, u->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sq_ptr == MAP_FAILED || u->cq_ptr == MAP_FAILED || u->sqes == MAP_FAILED) {
+    int err = errno;
+    if (u->sq_ptr != MAP_FAILED)
+      munmap(u->sq_ptr, u->sq_size);
+    if (u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+      munmap(u->cq_ptr, u->cq_size);
+    if (u->sqes != MAP_FAILED)
+      munmap(u->sqes, u->sqes_size);
+    close(u->fd);
+    return err;
+  }
+
+  uint8_t * sq = u->sq_ptr, * cq = u->cq_ptr;
+  u->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+  u->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p.sq_off.array);
+  u->cq_head  = (unsigned *)(cq + p.cq_off.head);
+  u->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+  u->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+static void uring_close (struct uring * u) {
+  munmap(u->sqes, u->sqes_size);
+  if (u->cq_ptr != u->sq_ptr)
+    munmap(u->cq_ptr, u->cq_size);
+  munmap(u->sq_ptr, u->sq_size);
+  close(u->fd);
+}
+
+// IORING_OP_READ is supported (probes appeared with it, in 5.6)
+static int uring_can_read (struct uring * u) {
+  size_t size = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+  struct io_uring_probe * p = calloc(1, size);
+  int ok = p && syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE, p, 256) == 0 &&
+    p->last_op >= IORING_OP_READ && (p->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  free(p);
+  return ok;
+}
+
+// Queue a read and submit it
+static int uring_read (struct uring * u, int fd, void * p, size_t len, off_t off, uint64_t id) {
+  unsigned tail = *u->sq_tail; // Single submitter
+  unsigned i = tail & *u->sq_mask;
+  struct io_uring_sqe * sqe = &u->sqes[i];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t)p;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = id;
+  u->sq_array[i] = i;
+  __atomic_store_n(u->sq_tail, tail+1, __ATOMIC_RELEASE);
+
+  for (;;) {
+    int r = syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0);
+    if (r == 1)
+      return 0;
+    if (r < 0 && errno != EINTR && errno != EAGAIN)
+      return errno;
+  }
+}
+
+// Next completion, waiting if there is none
+static int uring_wait (struct uring * u, uint64_t * id, int * res) {
+  for (;;) {
+    unsigned head = *u->cq_head;
+    if (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe * cqe = &u->cqes[head & *u->cq_mask];
+      *id = cqe->user_data;
+      *res = cqe->res;
+      __atomic_store_n(u->cq_head, head+1, __ATOMIC_RELEASE);
+      return 0;
+    }
+    int r = syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (r < 0 && errno != EINTR)
+      return errno;
+  }
+}
+
+static int tag_uring (struct MAC611_stream * st, int fd, off_t off, struct ring * r) {
+  struct uring u;
+  int err = uring_setup(&u, r->n);
+  if (err)
+    return err == ENOSYS || err == EPERM? ENOSYS: err;
+  if (!uring_can_read(&u)) {
+    uring_close(&u);
+    return ENOSYS;
+  }
+
+  int * res = malloc(r->n*sizeof(int));      // Result per buffer
+  int * done = calloc(r->n, sizeof(int));    // Completed, not hashed
+  off_t * pos = malloc(r->n*sizeof(off_t));  // File offset per buffer
+  int inflight = 0;
+  off_t next = off;
+  if (!res || !done || !pos)
+    err = ENOMEM;
+
+  for (int i=0; !err && i<r->n; i++, next+=r->size) {
+    pos[i] = next;
+    if (!(err = uring_read(&u, fd, r->buf[i], r->size, next, i)))
+      inflight++;
+  }
+
+  for (int i=0; !err; i = (i+1) % r->n) {
+    while (!done[i] && !err) {
+      uint64_t id;
+      int rs;
+      if (!(err = uring_wait(&u, &id, &rs))) {
+	inflight--;
+	res[id] = rs;
+	done[id] = 1;
+      }
+    }
+    if (err)
+      break;
+    if (res[i] < 0) {
+      err = -res[i];
+      break;
+    }
+
+    ssize_t len = res[i];
+    if (len > 0 && (size_t)len < r->size) {
+      ssize_t more = fill(fd, r->buf[i]+len, r->size-len, pos[i]+len, 1);
+      if (more < 0) {
+	err = -more;
+	break;
+      }
+      len += more;
+    }
+    MAC611_update(st, r->buf[i], len);
+    if ((size_t)len < r->size)
+      break; // End of file, later reads are discarded
+
+    done[i] = 0;
+    pos[i] = next;
+    if (!(err = uring_read(&u, fd, r->buf[i], r->size, next, i)))
+      inflight++;
+    next += r->size;
+  }
+
+  // The buffers are freed by the caller: wait for the reads still in flight
+  while (inflight > 0) {
+    uint64_t id;
+    int rs;
+    if (uring_wait(&u, &id, &rs))
+      break;
+    inflight--;
+  }
+  uring_close(&u);
+  free(res);
+  free(done);
+  free(pos);
+  return err;
+}
+#else
+static int tag_uring (struct MAC611_stream * st, int fd, off_t off, struct ring * r) {
+  (void)st; (void)fd; (void)off; (void)r;
+  return ENOSYS;
+}
+#endif
+
+int tagstream_fd (const struct MAC611_context * ctx, int fd, const struct tagstream_options * o,
+		  const uint8_t nonce[8], uint8_t tag[8], uint64_t * bytes) {
+  struct stat sb;
+  if (fstat(fd, &sb))
+    return errno;
+  off_t off = S_ISREG(sb.st_mode)? lseek(fd, 0, SEEK_CUR): -1;
+  int seekable = off >= 0;
+  enum tagstream_backend b = o? o->backend: TAGSTREAM_AUTO;
+  if (b == TAGSTREAM_URING && !seekable)
+    return EINVAL;
+
+  struct ring r;
+  int err = ring_alloc(&r, o);
+  struct MAC611_stream st;
+  MAC611_start(&st, ctx);
+
+  int uring = b == TAGSTREAM_URING || (b == TAGSTREAM_AUTO && seekable);
+  if (!err && uring) {
+    err = tag_uring(&st, fd, off, &r);
+    // Nothing was read when io_uring cannot be set up or cannot read
+    if (err == ENOSYS && b == TAGSTREAM_AUTO) {
+      err = 0;
+      uring = 0;
+    }
+  }
+  if (!err && !uring)
+    err = tag_thread(&st, fd, off, seekable, &r);
+  ring_free(&r);
+
+  if (err)
+    return err;
+  MAC611_finish(&st, nonce, tag);
+  if (bytes)
+    *bytes = st.len;
+  return 0;
+}
+
+const char * tagstream_backend_name (enum tagstream_backend b) {
+  switch (b) {
+  case TAGSTREAM_URING:  return "uring";
+  case TAGSTREAM_THREAD: return "thread";
+  default:               return "auto";
+  }
+}
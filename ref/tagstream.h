@@ -0,0 +1,46 @@
+/************************************************************
+ * MAC611 tools
+ * Double-buffered tagging of files and pipes
+ * (c) 2018-2019 XXXX
+ *
+ * Reads go to a ring of aligned buffers while the completed
+ * buffers are hashed with MAC611_update, so that the disk and
+ * the core work at the same time. The tag is the MAC611_tag of
+ * everything read from fd (from the current position).
+ ************************************************************/
+
+#ifndef TAGSTREAM_H
+#define TAGSTREAM_H
+
+#include <stdint.h>
+#include "MAC611.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum tagstream_backend {
+  TAGSTREAM_AUTO,   // io_uring for regular files if available, else thread
+  TAGSTREAM_URING,  // io_uring reads (regular files only)
+  TAGSTREAM_THREAD  // Reader thread with pread (read for pipes)
+};
+
+struct tagstream_options {
+  size_t buffer_size;  // Bytes per buffer (0: 1 MiB)
+  int buffers;         // Buffers in the ring (0: 4)
+  enum tagstream_backend backend;
+};
+
+// Returns 0, or an errno value (ENOSYS: io_uring unavailable or
+// without IORING_OP_READ, EINVAL: io_uring requested for a pipe).
+// *bytes can be NULL.
+int tagstream_fd (const struct MAC611_context * ctx, int fd, const struct tagstream_options * o,
+		  const uint8_t nonce[8], uint8_t tag[8], uint64_t * bytes);
+
+const char * tagstream_backend_name (enum tagstream_backend b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAGSTREAM_H
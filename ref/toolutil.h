@@ -0,0 +1,41 @@
+/************************************************************
+ * MAC611 tools
+ * Small helpers shared by the tools and the benchmarks
+ * (c) 2018-2019 XXXX
+ *
+ * Little-endian fields of the on-disk and wire formats, and a
+ * monotonic clock in nanoseconds.
+ ************************************************************/
+
+#ifndef TOOLUTIL_H
+#define TOOLUTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline void put32 (uint8_t * p, uint32_t x) {
+  for (int i=0; i<4; i++)
+    p[i] = x >> (8*i);
+}
+
+static inline void put64 (uint8_t * p, uint64_t x) {
+  for (int i=0; i<8; i++)
+    p[i] = x >> (8*i);
+}
+
+static inline uint32_t get32 (const uint8_t * p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t get64 (const uint8_t * p) {
+  return (uint64_t)get32(p+4) << 32 | get32(p);
+}
+
+// CLOCK_MONOTONIC
+static inline uint64_t now_ns (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+#endif // TOOLUTIL_H
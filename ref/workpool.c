@@ -0,0 +1,242 @@
+/************************************************************
+ * MAC611 tools
+ * Work-stealing thread pool
+ * (c) 2018-2019 XXXX
+ *
+ * Deques are growable rings protected by a mutex each: the owner
+ * and the thieves only contend on the same deque when it is
+ * nearly empty. Idle workers sleep on a condition variable.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "workpool.h"
+
+struct task {
+  work_fn fn;
+  void * arg;
+};
+
+struct deque {
+  pthread_mutex_t lock;
+  struct task * t;
+  size_t cap, top, bottom; // Tasks in [top, bottom), indices mod cap
+} __attribute__((aligned(64)));
+
+struct workpool {
+  int n;
+  pthread_t * threads;
+  struct deque * q;
+  unsigned next;          // Round robin for external submissions
+
+  pthread_mutex_t lock;   // Protects the fields below
+  pthread_cond_t work;    // Signaled when a task is submitted
+  pthread_cond_t done;    // Signaled when pending reaches 0
+  size_t queued;          // Tasks in the deques
+  size_t pending;         // Tasks submitted and not finished
+  int stop;
+};
+
+struct worker_arg {
+  struct workpool * pool;
+  int id;
+};
+
+static __thread int self = -1;
+static __thread struct workpool * self_pool = NULL;
+
+static int push (struct deque * d, struct task t) {
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom - d->top == d->cap) {
+    size_t cap = d->cap? 2*d->cap: 64;
+    struct task * n = malloc(cap*sizeof(*n));
+    if (!n) {
+      pthread_mutex_unlock(&d->lock);
+      return -1;
+    }
+    for (size_t i=d->top; i<d->bottom; i++)
+      n[i%cap] = d->t[i%d->cap];
+    free(d->t);
+    d->t = n;
+    d->cap = cap;
+  }
+  d->t[d->bottom++ % d->cap] = t;
+  pthread_mutex_unlock(&d->lock);
+  return 0;
+}
+
+// Owner side (newest task: better locality for nested submissions)
+static int pop (struct deque * d, struct task * t) {
+  int ok = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    *t = d->t[--d->bottom % d->cap];
+    ok = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ok;
+}
+
+// Thief side (oldest task: usually the largest subtree)
+static int steal (struct deque * d, struct task * t) {
+  int ok = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    *t = d->t[d->top++ % d->cap];
+    ok = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ok;
+}
+
+static int find (struct workpool * pool, int id, struct task * t, unsigned * seed) {
+  if (pop(&pool->q[id], t))
+    return 1;
+  int start = rand_r(seed) % pool->n;
+  for (int i=0; i<pool->n; i++) {
+    int v = (start+i) % pool->n;
+    if (v != id && steal(&pool->q[v], t))
+      return 1;
+  }
+  return 0;
+}
+
+static void * worker (void * p) {
+  struct worker_arg * a = p;
+  struct workpool * pool = a->pool;
+  int id = a->id;
+  unsigned seed = id+1;
+  free(a);
+  self = id;
+  self_pool = pool;
+
+  for (;;) {
+    struct task t;
+    if (find(pool, id, &t, &seed)) {
+      pthread_mutex_lock(&pool->lock);
+      pool->queued--;
+      pthread_mutex_unlock(&pool->lock);
+
+      t.fn(t.arg);
+
+      pthread_mutex_lock(&pool->lock);
+      if (--pool->pending == 0)
+	pthread_cond_broadcast(&pool->done);
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop && pool->queued == 0)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    int stop = pool->stop && pool->queued == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop)
+      return NULL;
+  }
+}
+
+struct workpool * workpool_create (int nthreads) {
+  if (nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads <= 0)
+    nthreads = 1;
+
+  struct workpool * pool = calloc(1, sizeof(*pool));
+  if (!pool)
+    return NULL;
+  pool->n = nthreads;
+  pool->threads = calloc(nthreads, sizeof(pthread_t));
+  if (posix_memalign((void **)&pool->q, 64, nthreads*sizeof(struct deque)))
+    pool->q = NULL;
+  if (!pool->threads || !pool->q) {
+    free(pool->threads);
+    free(pool->q);
+    free(pool);
+    return NULL;
+  }
+  memset(pool->q, 0, nthreads*sizeof(struct deque));
+  for (int i=0; i<nthreads; i++)
+    pthread_mutex_init(&pool->q[i].lock, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (int i=0; i<nthreads; i++) {
+    struct worker_arg * a = malloc(sizeof(*a));
+    if (a) {
+      a->pool = pool;
+      a->id = i;
+    }
+    if (!a || pthread_create(&pool->threads[i], NULL, worker, a)) {
+      free(a);
+      pool->n = i; // Destroy the started workers only
+      workpool_destroy(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+int workpool_submit (struct workpool * pool, work_fn fn, void * arg) {
+  struct task t = { fn, arg };
+  int id = self_pool == pool? self: (int)(__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) % pool->n);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->pending++;
+  pool->queued++;
+  pthread_mutex_unlock(&pool->lock);
+
+  if (push(&pool->q[id], t)) {
+    pthread_mutex_lock(&pool->lock);
+    pool->pending--;
+    pool->queued--;
+    if (pool->pending == 0)
+      pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+    return -1;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+void workpool_wait (struct workpool * pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void workpool_destroy (struct workpool * pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i=0; i<pool->n; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  for (int i=0; i<pool->n; i++) {
+    pthread_mutex_destroy(&pool->q[i].lock);
+    free(pool->q[i].t);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+  free(pool->threads);
+  free(pool->q);
+  free(pool);
+}
+
+int workpool_size (const struct workpool * pool) {
+  return pool->n;
+}
+
+int workpool_self (void) {
+  return self;
+}
@@ -0,0 +1,43 @@
+/************************************************************
+ * MAC611 tools
+ * Work-stealing thread pool
+ * (c) 2018-2019 XXXX
+ *
+ * Each worker has its own deque of tasks: it pushes and pops at
+ * the bottom, idle workers steal from the top of the others.
+ * Tasks submitted from outside the pool are spread round robin.
+ * Tasks can submit more tasks (e.g. directory traversal).
+ ************************************************************/
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct workpool;
+
+typedef void (*work_fn) (void * arg);
+
+// nthreads <= 0: one worker per online CPU. NULL on failure.
+struct workpool * workpool_create (int nthreads);
+
+// Returns 0, or -1 if out of memory
+int  workpool_submit (struct workpool * pool, work_fn fn, void * arg);
+
+// Wait until all submitted tasks (and the tasks they submitted) are done
+void workpool_wait (struct workpool * pool);
+
+void workpool_destroy (struct workpool * pool);
+
+int  workpool_size (const struct workpool * pool);
+
+// Index of the calling worker, -1 outside the pool
+int  workpool_self (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WORKPOOL_H